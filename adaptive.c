@@ -0,0 +1,119 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "jobqueue.h"
+#include "adaptive.h"
+#include "support.h"
+
+/* Adaptive concurrency (--adaptive=min:max). The maxissue of each
+ * execution place is tuned by hill climbing on the completion rate of the
+ * place. A measurement period ends when the place has completed at least
+ * 2 * maxissue jobs (and ADAPTIVE_MIN_JOBS) and ADAPTIVE_MIN_PERIOD has
+ * passed. If the period was faster than the previous one by more than
+ * ADAPTIVE_TOLERANCE, maxissue is moved one more step in the same
+ * direction. Otherwise the step is reversed, so that equal throughput is
+ * had with fewer running jobs, and maxissue oscillates around the knee.
+ *
+ * Tuning stops when the job queue is exhausted, because the completion
+ * rate then falls for other reasons.
+ */
+
+#define ADAPTIVE_MIN_JOBS 4
+#define ADAPTIVE_MIN_PERIOD 1000000000ULL
+#define ADAPTIVE_TOLERANCE 0.05
+
+struct adaptiveplace {
+	uint64_t periodstart;
+	int ncompleted;
+	int direction;
+	double lastrate;
+};
+
+static struct adaptiveplace *adaptiveplaces;
+static struct executionplace *adaptivebase;
+static int frozen;
+
+
+void adaptive_init(struct executionplace *places, int nplaces)
+{
+	int i;
+
+	adaptiveplaces = calloc(nplaces, sizeof adaptiveplaces[0]);
+	if (adaptiveplaces == NULL)
+		die("No memory for adaptive concurrency\n");
+
+	adaptivebase = places;
+
+	for (i = 0; i < nplaces; i++) {
+		if (places[i].maxissue < adaptivemin)
+			places[i].maxissue = adaptivemin;
+		if (places[i].maxissue > adaptivemax)
+			places[i].maxissue = adaptivemax;
+
+		adaptiveplaces[i].direction = 1;
+	}
+}
+
+
+/* Account a finished job. Returns 1 if maxissue of the place changed. */
+int adaptive_job_ack(struct executionplace *place,
+		     const struct job_ack *joback)
+{
+	struct adaptiveplace *ap;
+	uint64_t elapsed;
+	double rate;
+	int minjobs;
+	int newmaxissue;
+
+	if (adaptiveplaces == NULL || frozen || place->broken)
+		return 0;
+
+	ap = &adaptiveplaces[place - adaptivebase];
+
+	if (ap->periodstart == 0) {
+		ap->periodstart = joback->end;
+		return 0;
+	}
+
+	ap->ncompleted++;
+
+	minjobs = 2 * place->maxissue;
+	if (minjobs < ADAPTIVE_MIN_JOBS)
+		minjobs = ADAPTIVE_MIN_JOBS;
+
+	elapsed = joback->end - ap->periodstart;
+
+	if (ap->ncompleted < minjobs || joback->end < ap->periodstart ||
+	    elapsed < ADAPTIVE_MIN_PERIOD)
+		return 0;
+
+	rate = ap->ncompleted / (elapsed / 1000000000.0);
+
+	if (ap->lastrate > 0 && rate <= ap->lastrate * (1 + ADAPTIVE_TOLERANCE))
+		ap->direction = -ap->direction;
+
+	/* At a bound, stay for a period. The next period is no better, and
+	   the direction is reversed then. */
+	newmaxissue = place->maxissue + ap->direction;
+	if (newmaxissue < adaptivemin || newmaxissue > adaptivemax)
+		newmaxissue = place->maxissue;
+
+	ap->lastrate = rate;
+	ap->periodstart = joback->end;
+	ap->ncompleted = 0;
+
+	if (newmaxissue == place->maxissue)
+		return 0;
+
+	/* Jobs above a lowered limit are left to finish */
+	place->maxissue = newmaxissue;
+
+	return 1;
+}
+
+
+void adaptive_queue_exhausted(void)
+{
+	frozen = 1;
+}
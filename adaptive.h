@@ -0,0 +1,11 @@
+#ifndef _JOBQUEUE_ADAPTIVE_H_
+#define _JOBQUEUE_ADAPTIVE_H_
+
+#include "schedule.h"
+
+void adaptive_init(struct executionplace *places, int nplaces);
+int adaptive_job_ack(struct executionplace *place,
+		     const struct job_ack *joback);
+void adaptive_queue_exhausted(void);
+
+#endif
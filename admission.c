@@ -0,0 +1,264 @@
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdint.h>
+
+#include "jobqueue.h"
+#include "admission.h"
+#include "support.h"
+
+/* Admission control (--admission). A job is not started while
+ * MemAvailable of /proc/meminfo, less the memory hint of the job (see
+ * attributes.c), is below a reserve, or while the "some" avg10 value of
+ * /proc/pressure/memory exceeds a limit. The job is held, and the
+ * scheduler wakes up every ADMISSION_INTERVAL_MS to look again, so that
+ * throughput degrades by running fewer jobs instead of swapping.
+ *
+ * A new job takes a while to allocate its memory, and MemAvailable does
+ * not show it yet. Hints of jobs started in the last ADMISSION_RAMP_NS
+ * are therefore subtracted from MemAvailable, unless they have already
+ * finished. A job is always admitted if no jobs are running, so a hint
+ * larger than the machine does not stop the run.
+ */
+
+#define ADMISSION_INTERVAL_MS 200
+#define ADMISSION_RAMP_NS 5000000000ULL
+#define ADMISSION_NRECENT 1024
+
+struct recentjob {
+	const struct job *job;
+	uint64_t dispatchtime;
+	uint64_t mem;
+};
+
+static int enabled;
+static uint64_t reserve;
+static double psilimit = 10.0;
+
+static int meminfofd = -1;
+static int psifd = -1;
+
+static uint64_t lastread;
+static uint64_t memavailable;
+static double psi;
+
+static int nrunning;
+static int holding;
+
+/* Ring of recently started jobs with memory hints */
+static struct recentjob recent[ADMISSION_NRECENT];
+static int recenthead;
+static int nrecent;
+
+
+static ssize_t read_proc_file(int fd, char *buf, size_t size)
+{
+	ssize_t ret;
+
+	ret = pread(fd, buf, size - 1, 0);
+	if (ret < 0)
+		return -1;
+
+	buf[ret] = 0;
+
+	return ret;
+}
+
+
+/* Returns a /proc/meminfo field in bytes, or 0 if it is not found */
+static uint64_t meminfo_field(const char *meminfo, const char *name)
+{
+	const char *s = strstr(meminfo, name);
+
+	if (s == NULL)
+		return 0;
+
+	return strtoull(s + strlen(name), NULL, 10) * 1024;
+}
+
+
+static void read_pressure(void)
+{
+	char buf[4096];
+	const char *s;
+	uint64_t memtotal;
+
+	if (read_proc_file(meminfofd, buf, sizeof buf) < 0)
+		dieerror("Can not read /proc/meminfo");
+
+	memavailable = meminfo_field(buf, "\nMemAvailable:");
+
+	/* Kernels before 3.14 do not have MemAvailable */
+	if (memavailable == 0)
+		memavailable = meminfo_field(buf, "\nMemFree:") +
+			meminfo_field(buf, "\nCached:");
+
+	if (reserve == 0) {
+		memtotal = meminfo_field(buf, "MemTotal:");
+		reserve = memtotal / 10;
+	}
+
+	psi = 0.0;
+
+	if (psifd >= 0 && read_proc_file(psifd, buf, sizeof buf) > 0) {
+		s = strstr(buf, "some avg10=");
+		if (s != NULL)
+			psi = strtod(s + 11, NULL);
+	}
+
+	lastread = monotonic_ns();
+}
+
+
+/* spec is a comma separated list of mem=SIZE and psi=PERCENT, or NULL for
+ * defaults */
+void admission_init(const char *spec)
+{
+	char *copy = NULL;
+	char *item, *value, *saveptr, *endptr;
+
+	if (spec != NULL) {
+		copy = strdup(spec);
+		if (copy == NULL)
+			die("No memory for admission control\n");
+	}
+
+	for (item = (copy != NULL) ? strtok_r(copy, ",", &saveptr) : NULL;
+	     item != NULL; item = strtok_r(NULL, ",", &saveptr)) {
+		value = strchr(item, '=');
+		if (value == NULL)
+			die("Invalid admission parameter: %s\n", item);
+		*value++ = 0;
+
+		if (strcmp(item, "mem") == 0) {
+			if (parse_size(value, &reserve) || reserve == 0)
+				die("Invalid memory reserve: %s\n", value);
+		} else if (strcmp(item, "psi") == 0) {
+			psilimit = strtod(value, &endptr);
+			if (*endptr != 0 || !(psilimit > 0 && psilimit <= 100))
+				die("Invalid memory pressure limit: %s\n",
+				    value);
+		} else {
+			die("Unknown admission parameter: %s\n", item);
+		}
+	}
+
+	free(copy);
+
+	meminfofd = open("/proc/meminfo", O_RDONLY | O_CLOEXEC);
+	if (meminfofd < 0)
+		dieerror("Can not open /proc/meminfo");
+
+	/* Pressure stall information needs Linux 4.20 and CONFIG_PSI */
+	psifd = open("/proc/pressure/memory", O_RDONLY | O_CLOEXEC);
+	if (psifd < 0 && VERBOSE)
+		fprintf(stderr, "Memory pressure is not available, admission control uses MemAvailable only\n");
+
+	read_pressure();
+
+	enabled = 1;
+}
+
+
+/* Memory hints of jobs started within the ramp time */
+static uint64_t recent_memory(uint64_t now)
+{
+	uint64_t mem = 0;
+	int i;
+
+	while (nrecent > 0 &&
+	       recent[recenthead].dispatchtime + ADMISSION_RAMP_NS <= now) {
+		recenthead = (recenthead + 1) % ADMISSION_NRECENT;
+		nrecent--;
+	}
+
+	for (i = 0; i < nrecent; i++)
+		mem += recent[(recenthead + i) % ADMISSION_NRECENT].mem;
+
+	return mem;
+}
+
+
+/* Returns 1 if job may be started now */
+int admission_allow(const struct job *job)
+{
+	uint64_t now;
+	uint64_t pending;
+	int washolding = holding;
+
+	if (!enabled || nrunning == 0)
+		return 1;
+
+	now = monotonic_ns();
+
+	if (now - lastread >= ADMISSION_INTERVAL_MS * 1000000ULL)
+		read_pressure();
+
+	pending = recent_memory(now) + job->mem + reserve;
+
+	holding = (memavailable < pending || psi > psilimit);
+
+	if (holding && !washolding && VERBOSE)
+		fprintf(stderr, "Holding job %zd: MemAvailable %llu MiB, needs %llu MiB, memory pressure %.1f %%\n",
+			job->jobnumber,
+			(unsigned long long) (memavailable >> 20),
+			(unsigned long long) (pending >> 20), psi);
+
+	return !holding;
+}
+
+
+/* Returns milliseconds until a held job should be looked at again, or -1
+ * if no job is held */
+int admission_timeout(void)
+{
+	return holding ? ADMISSION_INTERVAL_MS : -1;
+}
+
+
+void admission_dispatch(const struct job *job)
+{
+	int i;
+
+	if (!enabled)
+		return;
+
+	nrunning++;
+	holding = 0;
+
+	if (job->mem == 0)
+		return;
+
+	if (nrecent == ADMISSION_NRECENT) {
+		/* Forget the oldest hint */
+		recenthead = (recenthead + 1) % ADMISSION_NRECENT;
+		nrecent--;
+	}
+
+	i = (recenthead + nrecent) % ADMISSION_NRECENT;
+	recent[i] = (struct recentjob) {.job = job,
+					.dispatchtime = monotonic_ns(),
+					.mem = job->mem};
+	nrecent++;
+}
+
+
+void admission_job_ack(const struct job *job)
+{
+	int i;
+
+	if (!enabled)
+		return;
+
+	nrunning--;
+
+	/* The memory of the job is free */
+	for (i = 0; i < nrecent; i++) {
+		if (recent[(recenthead + i) % ADMISSION_NRECENT].job == job)
+			recent[(recenthead + i) % ADMISSION_NRECENT].mem = 0;
+	}
+}
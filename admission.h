@@ -0,0 +1,12 @@
+#ifndef _JOBQUEUE_ADMISSION_H_
+#define _JOBQUEUE_ADMISSION_H_
+
+#include "schedule.h"
+
+void admission_init(const char *spec);
+int admission_allow(const struct job *job);
+int admission_timeout(void);
+void admission_dispatch(const struct job *job);
+void admission_job_ack(const struct job *job);
+
+#endif
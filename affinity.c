@@ -0,0 +1,108 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "jobqueue.h"
+#include "affinity.h"
+#include "support.h"
+
+/* Affinity keys (the affinity job attribute, see attributes.c). Jobs that
+ * share a key, for example jobs that read the same shard of a data set,
+ * run faster on the execution place that ran the key last, because the
+ * place has the data in its caches. The scheduler keeps a table of the
+ * last place of each key, and lets a job wait for that place for a while
+ * when the place is full (delay scheduling, see delay_job() in
+ * schedule.c).
+ *
+ * The table is an open addressing hash table of 64-bit key hashes, like
+ * the result cache. Key 0 marks an empty slot. The table is grown to keep
+ * the load factor below 1/2.
+ */
+
+#define AFFINITY_INITIAL_SLOTS 1024
+
+struct affinityslot {
+	uint64_t key;
+	int place;
+};
+
+static struct affinityslot *table;
+static size_t nslots;
+static size_t nused;
+
+
+uint64_t affinity_key(const char *s)
+{
+	uint64_t h = fmix64(fnv1a(FNV1A_INITIAL, s, strlen(s)));
+
+	/* 0 means no key */
+	return h ? h : 1;
+}
+
+
+static struct affinityslot *find_slot(struct affinityslot *t, size_t n,
+				      uint64_t key)
+{
+	size_t i = key & (n - 1);
+
+	while (t[i].key != 0 && t[i].key != key)
+		i = (i + 1) & (n - 1);
+
+	return &t[i];
+}
+
+
+static void grow_table(void)
+{
+	struct affinityslot *newtable;
+	size_t newn = nslots ? 2 * nslots : AFFINITY_INITIAL_SLOTS;
+	size_t i;
+
+	newtable = calloc(newn, sizeof newtable[0]);
+	if (newtable == NULL)
+		die("No memory for affinity keys\n");
+
+	for (i = 0; i < nslots; i++) {
+		if (table[i].key != 0)
+			*find_slot(newtable, newn, table[i].key) = table[i];
+	}
+
+	free(table);
+	table = newtable;
+	nslots = newn;
+}
+
+
+/* Returns the place that last ran a job with the key of job, or -1 */
+int affinity_place(const struct job *job)
+{
+	struct affinityslot *slot;
+
+	if (job->affinity == 0 || nused == 0)
+		return -1;
+
+	slot = find_slot(table, nslots, job->affinity);
+
+	return slot->key ? slot->place : -1;
+}
+
+
+void affinity_dispatch(const struct job *job, int place)
+{
+	struct affinityslot *slot;
+
+	if (job->affinity == 0)
+		return;
+
+	if (2 * (nused + 1) > nslots)
+		grow_table();
+
+	slot = find_slot(table, nslots, job->affinity);
+	if (slot->key == 0) {
+		slot->key = job->affinity;
+		nused++;
+	}
+
+	slot->place = place;
+}
@@ -0,0 +1,12 @@
+#ifndef _JOBQUEUE_AFFINITY_H_
+#define _JOBQUEUE_AFFINITY_H_
+
+#include <stdint.h>
+
+#include "schedule.h"
+
+uint64_t affinity_key(const char *s);
+int affinity_place(const struct job *job);
+void affinity_dispatch(const struct job *job, int place);
+
+#endif
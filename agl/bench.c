@@ -0,0 +1,336 @@
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#include "directedgraph.h"
+
+/* Benchmark for graph construction and algorithms. Each graph is built and
+ * measured in a child process, so that the peak memory (maximum RSS) is
+ * measured for that graph alone. Output is CSV:
+ *
+ * graph,nodes,fanout,edges,operation,seconds,ns_per_node,ns_per_edge,maxrss_kb
+ *
+ * nodes and edges are the ones that the operation visits. They are all
+ * nodes and edges of the graph, except for has_cycles, which only
+ * searches from node 0.
+ */
+
+enum graphtype {
+	GRAPH_RANDOM,
+	GRAPH_LAYERED,
+};
+
+static uint64_t rngstate;
+
+static const char *usage =
+"Usage: bench [-f fanout] [-n nodes] [-s seed] [-t random|layered]\n"
+"\n"
+"Without -n, graphs of 10^3 to 10^6 nodes are measured. Without -t, both\n"
+"random and layered DAGs are measured. The default fanout is 4.\n";
+
+
+/* xorshift64*: fast and reproducible over platforms */
+static uint64_t rng(void)
+{
+	rngstate ^= rngstate >> 12;
+	rngstate ^= rngstate << 25;
+	rngstate ^= rngstate >> 27;
+
+	return rngstate * 0x2545f4914f6cdd1dULL;
+}
+
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+
+static void add_edge(struct dgraph *graph, size_t src, size_t dst)
+{
+	if (agl_add_edge(graph, src, dst, NULL)) {
+		fprintf(stderr, "Can not add an edge %zd -> %zd\n", src, dst);
+		exit(1);
+	}
+}
+
+
+/* Each node i has fanout edges to random nodes j > i */
+static size_t add_random_edges(struct dgraph *graph, size_t fanout)
+{
+	size_t n = graph->n;
+	size_t nedges = 0;
+	size_t i, j;
+
+	for (i = 0; i + 1 < n; i++) {
+		for (j = 0; j < fanout; j++) {
+			add_edge(graph, i, i + 1 + rng() % (n - i - 1));
+			nedges++;
+		}
+	}
+
+	return nedges;
+}
+
+
+/* Layers of sqrt(n) nodes. Each node has fanout edges to random nodes of
+ * the next layer. */
+static size_t add_layered_edges(struct dgraph *graph, size_t fanout)
+{
+	size_t n = graph->n;
+	size_t width = 1;
+	size_t nedges = 0;
+	size_t i, j, next, nextwidth;
+
+	while (width * width < n)
+		width++;
+
+	for (i = 0; i < n; i++) {
+		next = (i / width + 1) * width;
+		if (next >= n)
+			break;
+
+		nextwidth = (n - next < width) ? (n - next) : width;
+
+		for (j = 0; j < fanout; j++) {
+			add_edge(graph, i, next + rng() % nextwidth);
+			nedges++;
+		}
+	}
+
+	return nedges;
+}
+
+
+static void report(const char *name, size_t n, size_t fanout, size_t nedges,
+		   const char *operation, double seconds)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+
+	printf("%s,%zd,%zd,%zd,%s,%.6f,%.1f,%.1f,%ld\n", name, n, fanout, nedges,
+	       operation, seconds, seconds * 1e9 / n,
+	       nedges ? seconds * 1e9 / nedges : 0.0, ru.ru_maxrss);
+	fflush(stdout);
+}
+
+
+static void bench_graph(enum graphtype type, size_t n, size_t fanout)
+{
+	const char *name = (type == GRAPH_RANDOM) ? "random" : "layered";
+	struct dgraph graph;
+	size_t nedges;
+	size_t *order;
+	double *blevels;
+	char *visited;
+	size_t nreached;
+	size_t nreachededges;
+	double t;
+	int cyclic;
+	size_t i;
+
+	if (agl_init(&graph, 0, NULL)) {
+		fprintf(stderr, "No graph\n");
+		exit(1);
+	}
+
+	t = now();
+	for (i = 0; i < n; i++) {
+		if (agl_add_node(&graph, NULL)) {
+			fprintf(stderr, "Can not add node %zd\n", i);
+			exit(1);
+		}
+	}
+	report(name, n, fanout, 0, "add_node", now() - t);
+
+	t = now();
+	if (type == GRAPH_RANDOM)
+		nedges = add_random_edges(&graph, fanout);
+	else
+		nedges = add_layered_edges(&graph, fanout);
+	report(name, n, fanout, nedges, "add_edge", now() - t);
+
+	visited = calloc(n, 1);
+	if (visited == NULL) {
+		fprintf(stderr, "No memory\n");
+		exit(1);
+	}
+
+	/* Search from every unvisited root like agl_topological_sort(), so
+	   that all nodes are visited */
+	t = now();
+	for (i = 0; i < n; i++) {
+		if (visited[i])
+			continue;
+
+		if (agl_dfs(&graph, i, visited, NULL, NULL, NULL) < 0) {
+			fprintf(stderr, "agl_dfs() failed\n");
+			exit(1);
+		}
+	}
+	report(name, n, fanout, nedges, "dfs", now() - t);
+
+	t = now();
+	order = agl_topological_sort(&cyclic, &graph);
+	if (order == NULL) {
+		fprintf(stderr, "agl_topological_sort() failed\n");
+		exit(1);
+	}
+	report(name, n, fanout, nedges, "topological_sort", now() - t);
+	free(order);
+
+	t = now();
+	blevels = agl_b_levels(&graph, NULL, NULL, NULL);
+	if (blevels == NULL) {
+		fprintf(stderr, "agl_b_levels() failed\n");
+		exit(1);
+	}
+	report(name, n, fanout, nedges, "b_levels", now() - t);
+	free(blevels);
+
+	t = now();
+	if (agl_has_cycles(&graph) != 0) {
+		fprintf(stderr, "agl_has_cycles() failed\n");
+		exit(1);
+	}
+	t = now() - t;
+
+	/* agl_has_cycles() only searches from node 0, so report costs per
+	   node and edge reachable from node 0 */
+	memset(visited, 0, n);
+	if (agl_dfs(&graph, 0, visited, NULL, NULL, NULL) < 0) {
+		fprintf(stderr, "agl_dfs() failed\n");
+		exit(1);
+	}
+
+	nreached = 0;
+	nreachededges = 0;
+	for (i = 0; i < n; i++) {
+		if (visited[i]) {
+			nreached++;
+			nreachededges += graph.nodes[i].nout;
+		}
+	}
+	report(name, nreached, fanout, nreachededges, "has_cycles", t);
+
+	free(visited);
+
+	agl_deinit(&graph);
+}
+
+
+static int run_child(enum graphtype type, size_t n, size_t fanout)
+{
+	pid_t pid;
+	int status;
+
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		exit(1);
+	}
+
+	if (pid == 0) {
+		bench_graph(type, n, fanout);
+		exit(0);
+	}
+
+	if (waitpid(pid, &status, 0) < 0) {
+		perror("waitpid");
+		exit(1);
+	}
+
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		fprintf(stderr, "Benchmark of %zd nodes failed\n", n);
+		return 1;
+	}
+
+	return 0;
+}
+
+
+int main(int argc, char *argv[])
+{
+	size_t fanout = 4;
+	size_t nodes = 0;
+	size_t n;
+	int types[2] = {GRAPH_RANDOM, GRAPH_LAYERED};
+	int ntypes = 2;
+	int i;
+	int opt;
+	int ret = 0;
+	char *endptr;
+
+	rngstate = 0x9e3779b97f4a7c15ULL;
+
+	while ((opt = getopt(argc, argv, "f:hn:s:t:")) != -1) {
+		switch (opt) {
+		case 'f':
+			fanout = strtoul(optarg, &endptr, 10);
+			if (*endptr != 0) {
+				fprintf(stderr, "Invalid fanout: %s\n", optarg);
+				exit(1);
+			}
+			break;
+		case 'n':
+			nodes = strtoul(optarg, &endptr, 10);
+			if (nodes == 0 || *endptr != 0) {
+				fprintf(stderr, "Invalid number of nodes: %s\n",
+					optarg);
+				exit(1);
+			}
+			break;
+		case 's':
+			rngstate = strtoull(optarg, &endptr, 10);
+			if (rngstate == 0 || *endptr != 0) {
+				fprintf(stderr, "Invalid seed: %s\n", optarg);
+				exit(1);
+			}
+			break;
+		case 't':
+			ntypes = 1;
+			if (strcmp(optarg, "random") == 0) {
+				types[0] = GRAPH_RANDOM;
+			} else if (strcmp(optarg, "layered") == 0) {
+				types[0] = GRAPH_LAYERED;
+			} else {
+				fprintf(stderr, "Unknown graph type: %s\n",
+					optarg);
+				exit(1);
+			}
+			break;
+		default:
+			fprintf(stderr, "%s", usage);
+			exit(opt == 'h' ? 0 : 1);
+		}
+	}
+
+	printf("graph,nodes,fanout,edges,operation,seconds,ns_per_node,ns_per_edge,maxrss_kb\n");
+	fflush(stdout);
+
+	for (i = 0; i < ntypes; i++) {
+		if (nodes > 0) {
+			ret |= run_child(types[i], nodes, fanout);
+			continue;
+		}
+
+		for (n = 1000; n <= 1000000; n *= 10)
+			ret |= run_child(types[i], n, fanout);
+	}
+
+	return ret;
+}
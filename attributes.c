@@ -0,0 +1,87 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "jobqueue.h"
+#include "affinity.h"
+#include "attributes.h"
+#include "support.h"
+
+/* A job line may begin with attributes in brackets:
+ *
+ *	[mem=2G,timeout=3600,affinity=scene1] ./render scene1
+ *
+ * Attributes are comma separated key=value pairs. They are not a part of
+ * the command. A line is only taken to have attributes if it begins with
+ * '[' followed by a letter, so that shell tests like "[ -f x ]" are
+ * commands.
+ */
+
+#define MAX_ATTRIBUTE_SIZE 256
+
+
+static void set_attribute(struct job *job, const char *key, const char *value,
+			  const char *line)
+{
+	double seconds;
+	char *end;
+
+	if (strcmp(key, "affinity") == 0) {
+		if (value[0] == 0)
+			die("Empty affinity key in job attributes: %s\n", line);
+		job->affinity = affinity_key(value);
+	} else if (strcmp(key, "mem") == 0) {
+		if (parse_size(value, &job->mem))
+			die("Invalid memory size in job attributes: %s\n", line);
+	} else if (strcmp(key, "timeout") == 0) {
+		seconds = strtod(value, &end);
+		if (*end != 0 || !(seconds > 0))
+			die("Invalid time limit in job attributes: %s\n", line);
+		job->timeout = seconds * 1000000000.0;
+	} else {
+		die("Unknown job attribute %s: %s\n", key, line);
+	}
+}
+
+
+/* Set attributes of job from line. Returns the offset of the command in
+ * line. */
+int parse_job_attributes(struct job *job, const char *line)
+{
+	char attributes[MAX_ATTRIBUTE_SIZE];
+	char *item, *value, *saveptr;
+	const char *end;
+	size_t len;
+	int i;
+
+	if (line[0] != '[' || !isalpha(line[1]))
+		return 0;
+
+	end = strchr(line, ']');
+	if (end == NULL)
+		die("Unterminated job attributes: %s\n", line);
+
+	len = end - (line + 1);
+	if (len >= sizeof attributes)
+		die("Too long job attributes: %s\n", line);
+
+	memcpy(attributes, line + 1, len);
+	attributes[len] = 0;
+
+	for (item = strtok_r(attributes, ",", &saveptr); item != NULL;
+	     item = strtok_r(NULL, ",", &saveptr)) {
+		value = strchr(item, '=');
+		if (value == NULL)
+			die("Invalid job attribute %s: %s\n", item, line);
+		*value++ = 0;
+
+		set_attribute(job, item, value, line);
+	}
+
+	i = skipws(line, end - line + 1);
+	if (i < 0)
+		die("No command after job attributes: %s\n", line);
+
+	return i;
+}
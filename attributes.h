@@ -0,0 +1,8 @@
+#ifndef _JOBQUEUE_ATTRIBUTES_H_
+#define _JOBQUEUE_ATTRIBUTES_H_
+
+#include "schedule.h"
+
+int parse_job_attributes(struct job *job, const char *line);
+
+#endif
@@ -0,0 +1,86 @@
+#!/bin/bash
+#
+# Dispatch throughput benchmark for jobqueue. Runs no-op jobs (true) with
+# different scheduler configurations and prints one CSV line per run:
+#
+#   benchmark,variant,places,slots,jobs,rep,wall_s,jobs_per_s,latency_p50_us,latency_p99_us
+#
+# Latency is the time from dispatch in the scheduler to job start in the
+# runner process, taken from --results. Lines starting with # describe the
+# environment.
+#
+# Environment variables: JOBS (jobs per run, default 2000), REPS (runs per
+# configuration, default 3), JOBQUEUE (binary, default ../jobqueue).
+
+export LC_ALL=C
+
+jobs=${JOBS:-2000}
+reps=${REPS:-3}
+com=${JOBQUEUE:-../jobqueue}
+
+tmpdir=$(mktemp -d)
+trap 'rm -rf "$tmpdir"' EXIT
+
+yes true |head -n $jobs > "$tmpdir/jobs"
+
+now() {
+    date +%s.%N
+}
+
+# Print p50 and p99 of dispatch to start latency in microseconds
+latency() {
+    awk -F, 'NR > 1 {printf "%.1f\n", ($6 - $5) * 1000000}' "$1" |sort -n |
+    awk '{a[NR] = $1}
+         END {if (NR == 0) {print "0,0"; exit}
+              printf "%s,%s\n", a[int((NR - 1) * 0.50) + 1], a[int((NR - 1) * 0.99) + 1]}'
+}
+
+# run benchmark variant places slots [jobqueue options ...]
+run() {
+    local benchmark=$1 variant=$2 places=$3 slots=$4
+    local rep start end wall
+    shift 4
+
+    for rep in $(seq $reps) ; do
+	start=$(now)
+	$com --results="$tmpdir/results" "$@" "$tmpdir/jobs" > /dev/null 2>&1
+	if test "$?" != "0" ; then
+	    echo "# $benchmark $variant failed" >&2
+	    continue
+	fi
+	end=$(now)
+
+	wall=$(echo "$start $end" |awk '{printf "%.6f", $2 - $1}')
+	echo "$benchmark,$variant,$places,$slots,$jobs,$rep,$wall,$(echo "$jobs $wall" |awk '{printf "%.1f", $1 / $2}'),$(latency "$tmpdir/results")"
+    done
+}
+
+# Machine list with the given number of places and slots per place
+machinelist() {
+    local i
+    for i in $(seq $1) ; do
+	echo "place$i $2"
+    done > "$tmpdir/machinelist"
+}
+
+echo "# jobqueue $($com --version |awk '{print $2}'), $(nproc) CPUs, $(uname -sr)"
+echo "# jobs $jobs, reps $reps"
+echo "benchmark,variant,places,slots,jobs,rep,wall_s,jobs_per_s,latency_p50_us,latency_p99_us"
+
+# Scaling with the number of parallel jobs
+for n in 1 2 4 8 16 32 ; do
+    run nodes "n$n" $n 1 -n $n
+done
+
+# Same number of slots (16) split over machine lists of different sizes
+for places in 1 2 4 8 16 ; do
+    slots=$((16 / places))
+    machinelist $places $slots
+    run machinelist "m$places" $places $slots -m "$tmpdir/machinelist"
+done
+
+# Restart modes and -e with 8 places
+run restart none 8 1 -n 8
+run restart r 8 1 -n 8 -r
+run restart max3 8 1 -n 8 --max-restart=3
+run executionplace e 8 1 -n 8 -e
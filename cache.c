@@ -0,0 +1,233 @@
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdint.h>
+#include <ctype.h>
+
+#include "jobqueue.h"
+#include "cache.h"
+#include "queue.h"
+#include "support.h"
+
+/* The result cache is a file that is mmap()ed as an open addressing hash
+ * table of 64-bit keys. A key is a hash of a job command (and optionally,
+ * the state of input files named in the command). A key is inserted when
+ * the job succeeds. Key 0 marks an empty slot. The number of slots is a
+ * power of two, and the table is grown to keep the load factor below 1/2.
+ *
+ * The cache must not be shared by simultaneously running jobqueue
+ * instances.
+ */
+
+#define CACHE_MAGIC "JQCACHE1"
+#define CACHE_INITIAL_SLOTS (1 << 16)
+
+struct cacheheader {
+	char magic[8];
+	uint64_t nslots;
+	uint64_t nused;
+};
+
+static const char *cachefname;
+static int cachefd = -1;
+static struct cacheheader *header;
+static uint64_t *slots;
+static size_t mapsize;
+
+
+/* Mix size and modification time of each command argument that names an
+ * existing file */
+static uint64_t hash_input_files(uint64_t h, const char *cmd)
+{
+	char name[MAX_CMD_SIZE];
+	struct stat st;
+	int i = 0;
+	int len;
+
+	while ((i = skipws(cmd, i)) >= 0) {
+		len = 0;
+		while (cmd[i] != 0 && !isspace(cmd[i]))
+			name[len++] = cmd[i++];
+		name[len] = 0;
+
+		if (stat(name, &st) || !S_ISREG(st.st_mode))
+			continue;
+
+		h = fnv1a(h, &st.st_size, sizeof st.st_size);
+		h = fnv1a(h, &st.st_mtim, sizeof st.st_mtim);
+	}
+
+	return h;
+}
+
+
+uint64_t cache_key(const char *cmd)
+{
+	uint64_t h = FNV1A_INITIAL;
+
+	h = fnv1a(h, cmd, strlen(cmd));
+
+	if (cacheinputs)
+		h = hash_input_files(h, cmd);
+
+	h = fmix64(h);
+
+	/* 0 marks an empty slot */
+	return h ? h : 1;
+}
+
+
+static void map_cache(int fd, uint64_t nslots, int create)
+{
+	size_t size = sizeof(*header) + nslots * sizeof(slots[0]);
+	void *map;
+
+	if (create && ftruncate(fd, size))
+		dieerror("Can not resize cache");
+
+	map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED)
+		dieerror("Can not mmap cache");
+
+	header = map;
+	slots = (uint64_t *) (header + 1);
+	mapsize = size;
+
+	if (create) {
+		memcpy(header->magic, CACHE_MAGIC, sizeof header->magic);
+		header->nslots = nslots;
+		header->nused = 0;
+	}
+}
+
+
+static uint64_t *find_slot(uint64_t *table, uint64_t nslots, uint64_t key)
+{
+	uint64_t mask = nslots - 1;
+	uint64_t i = key & mask;
+
+	while (table[i] != 0 && table[i] != key)
+		i = (i + 1) & mask;
+
+	return &table[i];
+}
+
+
+void cache_open(const char *fname)
+{
+	struct stat st;
+	struct cacheheader h;
+	ssize_t ret;
+
+	cachefname = fname;
+
+	cachefd = open(fname, O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+	if (cachefd < 0)
+		dieerror("Can not open cache %s", fname);
+
+	if (fstat(cachefd, &st))
+		dieerror("Can not stat cache %s", fname);
+
+	if (st.st_size == 0) {
+		map_cache(cachefd, CACHE_INITIAL_SLOTS, 1);
+		return;
+	}
+
+	ret = pread(cachefd, &h, sizeof h, 0);
+	if (ret != sizeof h || memcmp(h.magic, CACHE_MAGIC, sizeof h.magic) ||
+	    h.nslots == 0 || (h.nslots & (h.nslots - 1)) ||
+	    st.st_size != sizeof h + h.nslots * sizeof(slots[0]))
+		die("%s is not a valid jobqueue cache\n", fname);
+
+	map_cache(cachefd, h.nslots, 0);
+}
+
+
+int cache_lookup(uint64_t key)
+{
+	if (slots == NULL)
+		return 0;
+
+	return *find_slot(slots, header->nslots, key) == key;
+}
+
+
+/* Double the table into a new file, and atomically replace the old file */
+static void grow_cache(void)
+{
+	char tmpname[PATH_MAX];
+	uint64_t *oldslots = slots;
+	uint64_t oldnslots = header->nslots;
+	uint64_t nused = header->nused;
+	void *oldmap = header;
+	size_t oldmapsize = mapsize;
+	int fd;
+	uint64_t i;
+
+	if (snprintf(tmpname, sizeof tmpname, "%s.tmp", cachefname) >=
+	    sizeof tmpname)
+		die("Too long a cache file name: %s\n", cachefname);
+
+	fd = open(tmpname, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+	if (fd < 0)
+		dieerror("Can not create %s", tmpname);
+
+	map_cache(fd, 2 * oldnslots, 1);
+
+	for (i = 0; i < oldnslots; i++) {
+		if (oldslots[i] != 0)
+			*find_slot(slots, header->nslots, oldslots[i]) =
+				oldslots[i];
+	}
+
+	header->nused = nused;
+
+	if (rename(tmpname, cachefname))
+		dieerror("Can not replace cache %s", cachefname);
+
+	munmap(oldmap, oldmapsize);
+	close(cachefd);
+	cachefd = fd;
+}
+
+
+void cache_insert(uint64_t key)
+{
+	uint64_t *slot;
+
+	if (slots == NULL)
+		return;
+
+	if (2 * (header->nused + 1) > header->nslots)
+		grow_cache();
+
+	slot = find_slot(slots, header->nslots, key);
+	if (*slot == key)
+		return;
+
+	*slot = key;
+	header->nused++;
+}
+
+
+void cache_close(void)
+{
+	if (slots == NULL)
+		return;
+
+	munmap(header, mapsize);
+	close(cachefd);
+
+	header = NULL;
+	slots = NULL;
+	cachefd = -1;
+}
@@ -0,0 +1,12 @@
+#ifndef _JOBQUEUE_CACHE_H_
+#define _JOBQUEUE_CACHE_H_
+
+#include <stdint.h>
+
+void cache_open(const char *fname);
+uint64_t cache_key(const char *cmd);
+int cache_lookup(uint64_t key);
+void cache_insert(uint64_t key);
+void cache_close(void);
+
+#endif
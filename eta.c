@@ -0,0 +1,134 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <assert.h>
+
+#include "eta.h"
+#include "support.h"
+
+/* ETA is computed from exponentially weighted moving averages of job
+ * execution times (dispatch to completion) for each execution place. Each
+ * place completes maxissue / mean jobs per second, and the sum over working
+ * places is the total rate. Running jobs are counted as half done.
+ *
+ * The confidence band is two standard deviations of the remaining time,
+ * assuming independent job durations. It combines the variance of the sum
+ * of remaining durations and the error of the estimated mean.
+ */
+
+/* Weight of a new sample in moving averages */
+#define ETA_ALPHA 0.1
+
+struct ewma {
+	double mean;  /* seconds */
+	double var;
+	size_t n;
+};
+
+static struct ewma *placetimes;
+static int netaplaces;
+static struct ewma alltimes;
+
+
+static void ewma_update(struct ewma *e, double x)
+{
+	double diff;
+
+	if (e->n == 0) {
+		e->mean = x;
+		e->var = 0;
+	} else {
+		diff = x - e->mean;
+		e->mean += ETA_ALPHA * diff;
+		e->var = (1 - ETA_ALPHA) * (e->var + ETA_ALPHA * diff * diff);
+	}
+
+	e->n++;
+}
+
+
+void eta_init(int nplaces)
+{
+	netaplaces = nplaces;
+
+	placetimes = calloc(nplaces, sizeof placetimes[0]);
+	if (placetimes == NULL)
+		die("No memory for ETA computation\n");
+}
+
+
+void eta_job_ack(const struct job_ack *joback)
+{
+	double t = 0;
+
+	assert(joback->place < netaplaces);
+
+	if (joback->end > joback->job->dispatchtime)
+		t = (joback->end - joback->job->dispatchtime) / 1000000000.0;
+
+	ewma_update(&placetimes[joback->place], t);
+	ewma_update(&alltimes, t);
+}
+
+
+/* Estimate time to complete njobs jobs when jobsdone jobs are done.
+ * Returns 0 on success, and -1 if there is no estimate yet.
+ */
+int eta_estimate(struct etaestimate *est, size_t jobsdone, size_t njobs,
+		 const struct executionplace *places, int nplaces)
+{
+	double rate = 0;
+	double mean, work, cv, neff, rel;
+	size_t running = 0;
+	size_t remaining;
+	int i;
+
+	assert(nplaces == netaplaces);
+
+	if (alltimes.n == 0 || njobs < jobsdone)
+		return -1;
+
+	for (i = 0; i < nplaces; i++) {
+		if (places[i].broken)
+			continue;
+
+		mean = placetimes[i].n ? placetimes[i].mean : alltimes.mean;
+		if (mean < 1e-6)
+			mean = 1e-6;
+
+		rate += places[i].maxissue / mean;
+		running += places[i].jobsrunning;
+	}
+
+	if (rate == 0)
+		return -1;
+
+	remaining = njobs - jobsdone;
+	if (running > remaining)
+		running = remaining;
+
+	work = remaining - running / 2.0;
+
+	est->rate = rate;
+	est->eta = work / rate;
+
+	/* The last job takes at least about half of a job time */
+	if (remaining > 0 && est->eta < alltimes.mean / 2)
+		est->eta = alltimes.mean / 2;
+
+	cv = (alltimes.mean > 0) ? sqrt(alltimes.var) / alltimes.mean : 0;
+
+	/* Effective number of samples in the moving average */
+	neff = (2 - ETA_ALPHA) / ETA_ALPHA;
+	if (alltimes.n < neff)
+		neff = alltimes.n;
+
+	rel = (work > 0) ? 2 * cv * sqrt(1 / work + 1 / neff) : 0;
+
+	est->low = est->eta * (1 - rel);
+	if (est->low < 0)
+		est->low = 0;
+	est->high = est->eta * (1 + rel);
+
+	return 0;
+}
@@ -0,0 +1,18 @@
+#ifndef _JOBQUEUE_ETA_H_
+#define _JOBQUEUE_ETA_H_
+
+#include "schedule.h"
+
+struct etaestimate {
+	double rate;  /* jobs per second */
+	double eta;   /* seconds */
+	double low;   /* lower and upper bound of ETA in seconds */
+	double high;
+};
+
+void eta_init(int nplaces);
+void eta_job_ack(const struct job_ack *joback);
+int eta_estimate(struct etaestimate *est, size_t jobsdone, size_t njobs,
+		 const struct executionplace *places, int nplaces);
+
+#endif
@@ -0,0 +1,297 @@
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include "eventlog.h"
+#include "schedule.h"
+#include "support.h"
+
+/* The event log is a ring of fixed size binary records in memory. Recording
+ * an event is a clock read and a few stores. The ring is written to the
+ * event log file on SIGUSR2, at exit and when jobqueue dies, so the last
+ * EVENTLOG_NEVENTS events before a problem can be inspected afterwards with
+ * --decode-events.
+ *
+ * The file is a header followed by events from oldest to newest. It is
+ * rewritten on each flush.
+ */
+
+#define EVENTLOG_MAGIC "JQEVLOG1"
+#define EVENTLOG_NEVENTS 65536
+
+struct eventlogheader {
+	char magic[8];
+	uint64_t nevents;
+	/* Number of older events that were overwritten in the ring */
+	uint64_t nlost;
+};
+
+struct event {
+	/* Nanoseconds from eventlog_open() */
+	uint64_t time;
+	/* -1 if not applicable */
+	int64_t jobnumber;
+	uint32_t type;
+	int32_t place;
+	int32_t slot;
+	/* Number of retries (dispatch, retry), job result (ack) or number
+	 * of jobs read (queue exhausted) */
+	int32_t arg;
+};
+
+static const char *eventlogfname;
+static pid_t ownerpid;
+static uint64_t eventlogstart;
+static struct event *ring;
+static uint64_t nrecorded;
+
+static volatile sig_atomic_t flushrequested;
+
+static const char *eventnames[EVENT_TYPE_MAXIMUM] = {
+	[EVENT_DISPATCH] = "dispatch",
+	[EVENT_ACK] = "ack",
+	[EVENT_RETRY] = "retry",
+	[EVENT_PLACE_BROKEN] = "place_broken",
+	[EVENT_QUEUE_EXHAUSTED] = "queue_exhausted",
+	[EVENT_TIMEOUT] = "timeout",
+	[EVENT_PLACE_RESTORED] = "place_restored",
+};
+
+static const char *resultnames[JOB_RESULT_MAXIMUM] = {
+	[JOB_SUCCESS] = "success",
+	[JOB_FAILURE] = "failure",
+	[JOB_BROKEN_EXECUTION_PLACE] = "broken_place",
+};
+
+
+static int write_all(int fd, const void *data, size_t len)
+{
+	const char *p = data;
+	ssize_t ret;
+
+	while (len > 0) {
+		ret = write(fd, p, len);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		p += ret;
+		len -= ret;
+	}
+
+	return 0;
+}
+
+
+/* This is also called from an atexit() handler, so errors are only
+ * reported */
+static void eventlog_flush(void)
+{
+	struct eventlogheader header = {.magic = EVENTLOG_MAGIC};
+	uint64_t first = 0;
+	size_t head;
+	int fd;
+
+	if (nrecorded > EVENTLOG_NEVENTS)
+		first = nrecorded - EVENTLOG_NEVENTS;
+
+	header.nevents = nrecorded - first;
+	header.nlost = first;
+
+	fd = open(eventlogfname, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+	if (fd < 0) {
+		fprintf(stderr, "Can not open event log %s: %s\n",
+			eventlogfname, strerror(errno));
+		return;
+	}
+
+	head = first % EVENTLOG_NEVENTS;
+
+	if (write_all(fd, &header, sizeof header) ||
+	    write_all(fd, ring + head, (header.nevents - (first ? head : 0)) *
+		      sizeof ring[0]) ||
+	    (first && write_all(fd, ring, head * sizeof ring[0])))
+		fprintf(stderr, "Can not write event log %s: %s\n",
+			eventlogfname, strerror(errno));
+
+	close(fd);
+}
+
+
+/* die() calls exit(), also in runner children */
+static void eventlog_atexit(void)
+{
+	if (eventlogfname != NULL && getpid() == ownerpid)
+		eventlog_flush();
+}
+
+
+static void eventlog_sigusr2(int sig)
+{
+	flushrequested = 1;
+}
+
+
+void eventlog_open(const char *fname)
+{
+	struct sigaction act = {.sa_handler = eventlog_sigusr2};
+
+	ring = malloc(EVENTLOG_NEVENTS * sizeof ring[0]);
+	if (ring == NULL)
+		die("No memory for event log\n");
+
+	eventlogfname = fname;
+	ownerpid = getpid();
+	eventlogstart = monotonic_ns();
+
+	atexit(eventlog_atexit);
+
+	/* No SA_RESTART: waiting for job acks is interrupted, so the
+	   scheduler loop flushes the log without delay */
+	sigemptyset(&act.sa_mask);
+	if (sigaction(SIGUSR2, &act, NULL) < 0)
+		dieerror("Can not install SIGUSR2 handler");
+}
+
+
+void eventlog_record(enum event_type type, long long jobnumber, int place,
+		     int slot, int arg)
+{
+	struct event *e;
+
+	if (ring == NULL)
+		return;
+
+	e = &ring[nrecorded % EVENTLOG_NEVENTS];
+	*e = (struct event) {.time = monotonic_ns() - eventlogstart,
+			     .jobnumber = jobnumber,
+			     .type = type,
+			     .place = place,
+			     .slot = slot,
+			     .arg = arg};
+	nrecorded++;
+}
+
+
+/* Called from the scheduler loop */
+void eventlog_check_signal(void)
+{
+	if (!flushrequested)
+		return;
+
+	flushrequested = 0;
+
+	if (eventlogfname != NULL)
+		eventlog_flush();
+}
+
+
+void eventlog_close(void)
+{
+	if (eventlogfname == NULL)
+		return;
+
+	eventlog_flush();
+
+	eventlogfname = NULL;
+	free(ring);
+	ring = NULL;
+}
+
+
+static void print_event(const struct event *e)
+{
+	const char *name = "unknown";
+
+	if (e->type < EVENT_TYPE_MAXIMUM && eventnames[e->type] != NULL)
+		name = eventnames[e->type];
+
+	printf("%16.9f %-15s", e->time / 1000000000.0, name);
+
+	switch (e->type) {
+	case EVENT_DISPATCH:
+		printf(" job %lld place %d slot %d retries %d\n",
+		       (long long) e->jobnumber, e->place + 1, e->slot + 1,
+		       e->arg);
+		break;
+
+	case EVENT_ACK:
+		printf(" job %lld place %d slot %d result %s\n",
+		       (long long) e->jobnumber, e->place + 1, e->slot + 1,
+		       (e->arg >= 0 && e->arg < JOB_RESULT_MAXIMUM) ?
+		       resultnames[e->arg] : "invalid");
+		break;
+
+	case EVENT_RETRY:
+		printf(" job %lld place %d retries %d\n",
+		       (long long) e->jobnumber, e->place + 1, e->arg);
+		break;
+
+	case EVENT_PLACE_BROKEN:
+	case EVENT_PLACE_RESTORED:
+		printf(" place %d\n", e->place + 1);
+		break;
+
+	case EVENT_QUEUE_EXHAUSTED:
+		printf(" jobs read %d\n", e->arg);
+		break;
+
+	case EVENT_TIMEOUT:
+		printf(" job %lld place %d slot %d\n",
+		       (long long) e->jobnumber, e->place + 1, e->slot + 1);
+		break;
+
+	default:
+		printf(" type %u\n", e->type);
+	}
+}
+
+
+/* Print an event log file as text. Returns an exit code. */
+int eventlog_decode(const char *fname)
+{
+	struct eventlogheader header;
+	struct event e;
+	uint64_t i;
+	FILE *f;
+
+	f = fopen(fname, "r");
+	if (f == NULL) {
+		fprintf(stderr, "Can not open %s: %s\n", fname, strerror(errno));
+		return 1;
+	}
+
+	if (fread(&header, sizeof header, 1, f) != 1 ||
+	    memcmp(header.magic, EVENTLOG_MAGIC, sizeof header.magic)) {
+		fprintf(stderr, "%s is not a jobqueue event log\n", fname);
+		fclose(f);
+		return 1;
+	}
+
+	printf("# %llu events, %llu older events lost\n",
+	       (unsigned long long) header.nevents,
+	       (unsigned long long) header.nlost);
+
+	for (i = 0; i < header.nevents; i++) {
+		if (fread(&e, sizeof e, 1, f) != 1) {
+			fprintf(stderr, "%s is truncated\n", fname);
+			fclose(f);
+			return 1;
+		}
+
+		print_event(&e);
+	}
+
+	fclose(f);
+
+	return 0;
+}
@@ -0,0 +1,25 @@
+#ifndef _JOBQUEUE_EVENTLOG_H_
+#define _JOBQUEUE_EVENTLOG_H_
+
+#include <stddef.h>
+
+enum event_type {
+	EVENT_DISPATCH = 1,
+	EVENT_ACK,
+	EVENT_RETRY,
+	EVENT_PLACE_BROKEN,
+	EVENT_QUEUE_EXHAUSTED,
+	EVENT_TIMEOUT,
+	EVENT_PLACE_RESTORED,
+	EVENT_TYPE_MAXIMUM,
+};
+
+void eventlog_open(const char *fname);
+void eventlog_record(enum event_type type, long long jobnumber, int place,
+		     int slot, int arg);
+void eventlog_check_signal(void);
+void eventlog_close(void);
+
+int eventlog_decode(const char *fname);
+
+#endif
@@ -0,0 +1,592 @@
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+#include <poll.h>
+#include <math.h>
+#include <assert.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#include "executor.h"
+#include "jobqueue.h"
+#include "pin.h"
+#include "support.h"
+
+/* Process executor: a runner process is forked for each job. The runner
+ * executes the job with a shell, and writes a struct job_ack into a pipe
+ * that is shared by all runners. A job is killed by sending SIGTERM to its
+ * runner, which kills the job and reports it as failed.
+ *
+ * A job that may be killed (see job_is_killable()) runs in a process group
+ * of its own, so that it is killed with all of its children. Other jobs
+ * stay in the process group of jobqueue like with system(), so that they
+ * can use the terminal, for example to ask for a password.
+ *
+ * A runner is reaped only after its ack has been read. Until then its pid
+ * can not be reused, so a job that has not been reported can always be
+ * killed through its runner pid. */
+
+struct processexecutor {
+	int ackpipe[2];
+};
+
+/* Shell process of the job in a runner process, and owngroup != 0 if it
+ * leads a process group of its own */
+static volatile pid_t jobpid;
+static volatile int owngroup;
+
+
+static void forward_signal(int signum)
+{
+	if (jobpid <= 0)
+		return;
+
+	if (signum != SIGTERM)
+		kill(-jobpid, signum);
+	else if (owngroup)
+		kill(-jobpid, SIGKILL);
+	else
+		kill(jobpid, SIGKILL);
+}
+
+
+/* Jobs are only killed for speculative execution and time limits. Probe
+ * commands of --probe are killed at the end of the run, but only their
+ * shell is killed. */
+static int job_is_killable(const struct job *job)
+{
+	return speculatefactor > 0 || job->timeout != 0;
+}
+
+
+/* Like system(), but SIGTERM kills the job. With newgroup != 0, the
+ * command runs in its own process group, so that it can be killed with
+ * all of its children. The job is then not in the foreground process
+ * group of a terminal, so terminal signals are passed on to it. SIGTERM is
+ * blocked in the runner until the job has started. */
+static int run_command(const char *cmd, int newgroup)
+{
+	struct sigaction act = {.sa_handler = forward_signal};
+	struct sigaction ignore = {.sa_handler = SIG_IGN};
+	sigset_t unblock;
+	pid_t pid;
+	int status;
+
+	sigaction(SIGTERM, &act, NULL);
+
+	if (newgroup) {
+		sigaction(SIGINT, &act, NULL);
+		sigaction(SIGQUIT, &act, NULL);
+		sigaction(SIGHUP, &act, NULL);
+	} else {
+		/* The terminal signals the job directly, as with system() */
+		sigaction(SIGINT, &ignore, NULL);
+		sigaction(SIGQUIT, &ignore, NULL);
+	}
+
+	sigemptyset(&unblock);
+	sigaddset(&unblock, SIGTERM);
+
+	pid = fork();
+	if (pid == 0) {
+		if (newgroup)
+			setpgid(0, 0);
+		signal(SIGINT, SIG_DFL);
+		signal(SIGQUIT, SIG_DFL);
+		sigprocmask(SIG_UNBLOCK, &unblock, NULL);
+		execl("/bin/sh", "sh", "-c", cmd, (char *) NULL);
+		_exit(127);
+	} else if (pid < 0) {
+		return -1;
+	}
+
+	/* Both processes set the group, so that it exists before a signal
+	   is forwarded */
+	if (newgroup)
+		setpgid(pid, pid);
+
+	owngroup = newgroup;
+	jobpid = pid;
+
+	sigprocmask(SIG_UNBLOCK, &unblock, NULL);
+
+	while (waitpid(pid, &status, 0) < 0) {
+		if (errno != EINTR)
+			return -1;
+	}
+
+	return status;
+}
+
+
+static void write_job_ack(int fd, struct job_ack joback, const char *cmd)
+{
+	ssize_t ret;
+
+	/* pipe(7) guarantees write atomicity when size <= PIPE_BUF */
+	assert(sizeof(joback) <= PIPE_BUF);
+
+	ret = write(fd, &joback, sizeof joback);
+	if (ret < 0)
+		die("PS %d job ack failed: %s\n", joback.place, cmd);
+
+	if (ret != sizeof(joback))
+		die("Unaligned write: returned %zd\n", ret);
+}
+
+
+static void run(struct job *job, int ps, int fd)
+{
+	ssize_t ret;
+	char cmd[MAX_CMD_SIZE];
+	char id[32];
+	struct job_ack joback = {.job = job,
+				 .place = ps,
+	                         .result = JOB_FAILURE};
+	struct machine *m;
+
+	joback.start = monotonic_ns();
+	joback.end = joback.start;
+
+	if (!vplist_is_empty(&machinelist)) {
+		m = vplist_get(&machinelist, ps);
+		assert(m != NULL);
+
+		ret = snprintf(cmd, sizeof cmd, "%s %s", job->cmd, m->name);
+	} else if (passexecutionplace) {
+		ret = snprintf(cmd, sizeof cmd, "%s %d", job->cmd, ps + 1);
+	} else {
+		ret = snprintf(cmd, sizeof cmd, "%s", job->cmd);
+	}
+
+	if (ret >= sizeof(cmd)) {
+		write_job_ack(fd, joback, cmd);
+		die("Too long a command: %s\n", job->cmd);
+	}
+
+	if (VERBOSE)
+		fprintf(stderr, "Job %zd execute: %s\n", job->jobnumber, cmd);
+
+	/* Tell the job where it runs */
+	snprintf(id, sizeof id, "%d", ps + 1);
+	setenv("JOBQUEUE_PLACE", id, 1);
+	snprintf(id, sizeof id, "%d", job->slot + 1);
+	setenv("JOBQUEUE_SLOT", id, 1);
+
+	pin_job(ps, job->slot);
+
+	joback.start = monotonic_ns();
+	ret = run_command(cmd, job_is_killable(job));
+	joback.end = monotonic_ns();
+
+	if (ret == -1) {
+		write_job_ack(fd, joback, cmd);
+		die("job delivery failed: %s\n", cmd);
+	}
+
+	/* The runner process has no other children than the job */
+	getrusage(RUSAGE_CHILDREN, &joback.rusage);
+
+	/* A job that was killed by a signal failed */
+	ret = WIFEXITED(ret) ? WEXITSTATUS(ret) : JOB_FAILURE;
+
+	if (ret < JOB_RESULT_MAXIMUM) {
+		joback.result = ret;
+	} else {
+		/* Mark large return code as a failure */
+		joback.result = JOB_FAILURE;
+
+		if (requeuefailedjobs)
+			fprintf(stderr, "Invalid return code %d from: %s\n"
+				"Intepreting this as a failure.\n",
+				(int) ret, cmd);
+	}
+
+	write_job_ack(fd, joback, cmd);
+}
+
+
+static void process_start(struct executor *executor, struct job *job,
+			  int place)
+{
+	struct processexecutor *pe = executor->data;
+	pid_t child;
+	sigset_t block, oldmask;
+
+	/* A kill right after start must wait until the runner has a job */
+	sigemptyset(&block);
+	sigaddset(&block, SIGTERM);
+	sigprocmask(SIG_BLOCK, &block, &oldmask);
+
+	child = fork();
+	if (child == 0) {
+		/* Close some child file descriptors */
+		close(0);
+		close(pe->ackpipe[0]);
+
+		run(job, place, pe->ackpipe[1]);
+
+		/* exit() would lseek() the shared job file descriptor back
+		   to the child's stdio read position, which makes the parent
+		   re-read jobs from regular job files */
+		_exit(0);
+	} else if (child < 0) {
+		die("Can not fork()\n");
+	}
+
+	sigprocmask(SIG_SETMASK, &oldmask, NULL);
+
+	job->runner = child;
+}
+
+
+static void process_kill(struct executor *executor, struct job *job)
+{
+	/* The runner may have finished already, and then its ack is in the
+	   pipe. The runner is not reaped yet, so the pid is still its own. */
+	kill(job->runner, SIGTERM);
+}
+
+
+static int process_wait(struct executor *executor, struct job_ack *joback,
+			int timeout)
+{
+	struct processexecutor *pe = executor->data;
+	struct pollfd pfd = {.fd = pe->ackpipe[0], .events = POLLIN};
+	ssize_t ret;
+
+	if (timeout >= 0 && poll(&pfd, 1, timeout) <= 0)
+		return 0;
+
+	ret = read(pe->ackpipe[0], joback, sizeof *joback);
+
+	if (ret < 0) {
+		if (errno == EAGAIN || errno == EINTR)
+			return 0;
+
+		die("read %zd: %s)\n", ret, strerror(errno));
+	} else if (ret == 0) {
+		die("Job queue pipe was broken\n");
+	}
+
+	if (ret != sizeof(*joback))
+		die("Unaligned read: returned %zd\n", ret);
+
+	/* The runner exits right after writing the ack */
+	while (waitpid(joback->job->runner, NULL, 0) < 0) {
+		if (errno != EINTR)
+			die("Can not wait for runner %d: %s\n",
+			    (int) joback->job->runner, strerror(errno));
+	}
+
+	return 1;
+}
+
+
+static void process_close(struct executor *executor)
+{
+	struct processexecutor *pe = executor->data;
+
+	close(pe->ackpipe[0]);
+	close(pe->ackpipe[1]);
+
+	free(pe);
+	free(executor);
+}
+
+
+struct executor *process_executor_create(void)
+{
+	struct executor *executor;
+	struct processexecutor *pe;
+
+	executor = calloc(1, sizeof executor[0]);
+	pe = calloc(1, sizeof pe[0]);
+	if (executor == NULL || pe == NULL)
+		die("No memory for executor\n");
+
+	if (pipe_closeonexec(pe->ackpipe))
+		die("Can not create a pipe: %s\n", strerror(errno));
+
+	*executor = (struct executor) {.start = process_start,
+				       .wait = process_wait,
+				       .kill = process_kill,
+				       .close = process_close,
+				       .data = pe};
+
+	return executor;
+}
+
+
+/* Fake executor: nothing is executed. Each job gets a duration from an
+ * exponential distribution and a result drawn with the given failure
+ * probabilities. Jobs finish in the order of simulated finish times, and
+ * wait() returns immediately. The random number generator is seeded, so a
+ * run is deterministic.
+ *
+ * Reported start and end times are the dispatch time and dispatch time +
+ * duration, so statistics and ETA see the synthetic durations.
+ */
+
+struct fakejob {
+	uint64_t finish;  /* Simulated finish time in ns */
+	uint64_t seq;     /* Ties are broken in dispatch order */
+	struct job *job;
+	int place;
+	uint64_t duration;
+	enum job_result result;
+};
+
+struct fakeexecutor {
+	uint64_t rngstate;
+	double mean;      /* Mean duration in seconds */
+	double pfail;     /* Probability of result 1 */
+	double pbroken;   /* Probability of result 2 */
+
+	uint64_t now;     /* Simulated time in ns */
+	uint64_t seq;
+
+	/* Running jobs as a binary min-heap by (finish, seq) */
+	struct fakejob *heap;
+	size_t n;
+	size_t allocated;
+};
+
+
+/* xorshift64* */
+static uint64_t fake_rng(struct fakeexecutor *fe)
+{
+	fe->rngstate ^= fe->rngstate >> 12;
+	fe->rngstate ^= fe->rngstate << 25;
+	fe->rngstate ^= fe->rngstate >> 27;
+
+	return fe->rngstate * 0x2545f4914f6cdd1dULL;
+}
+
+
+/* Uniform random number in (0, 1] */
+static double fake_uniform(struct fakeexecutor *fe)
+{
+	return ((fake_rng(fe) >> 11) + 1) * (1.0 / 9007199254740992.0);
+}
+
+
+static int fakejob_before(const struct fakejob *a, const struct fakejob *b)
+{
+	if (a->finish != b->finish)
+		return a->finish < b->finish;
+
+	return a->seq < b->seq;
+}
+
+
+static void fake_start(struct executor *executor, struct job *job, int place)
+{
+	struct fakeexecutor *fe = executor->data;
+	struct fakejob fj;
+	struct fakejob *newheap;
+	double u;
+	size_t i;
+
+	if (fe->n == fe->allocated) {
+		fe->allocated = fe->allocated ? 2 * fe->allocated : 64;
+		newheap = realloc(fe->heap, fe->allocated * sizeof fe->heap[0]);
+		if (newheap == NULL)
+			die("No memory for fake executor\n");
+		fe->heap = newheap;
+	}
+
+	fj = (struct fakejob) {.seq = fe->seq++,
+			       .job = job,
+			       .place = place,
+			       .result = JOB_SUCCESS};
+
+	fj.duration = -fe->mean * log(fake_uniform(fe)) * 1000000000.0;
+	fj.finish = fe->now + fj.duration;
+
+	u = fake_uniform(fe);
+	if (u <= fe->pbroken)
+		fj.result = JOB_BROKEN_EXECUTION_PLACE;
+	else if (u <= fe->pbroken + fe->pfail)
+		fj.result = JOB_FAILURE;
+
+	/* Sift up */
+	i = fe->n++;
+	while (i > 0 && fakejob_before(&fj, &fe->heap[(i - 1) / 2])) {
+		fe->heap[i] = fe->heap[(i - 1) / 2];
+		i = (i - 1) / 2;
+	}
+	fe->heap[i] = fj;
+}
+
+
+static int fake_wait(struct executor *executor, struct job_ack *joback,
+		     int timeout)
+{
+	struct fakeexecutor *fe = executor->data;
+	struct fakejob fj;
+	struct fakejob last;
+	size_t i, child;
+
+	if (fe->n == 0) {
+		if (timeout < 0)
+			die("Fake executor has no running jobs\n");
+
+		/* Nothing runs, but the scheduler waits for something else,
+		   such as a probe of a broken place */
+		poll(NULL, 0, timeout);
+		return 0;
+	}
+
+	fj = fe->heap[0];
+	fe->now = fj.finish;
+
+	/* Sift down the last element from the root */
+	last = fe->heap[--fe->n];
+	i = 0;
+	while ((child = 2 * i + 1) < fe->n) {
+		if (child + 1 < fe->n &&
+		    fakejob_before(&fe->heap[child + 1], &fe->heap[child]))
+			child++;
+
+		if (!fakejob_before(&fe->heap[child], &last))
+			break;
+
+		fe->heap[i] = fe->heap[child];
+		i = child;
+	}
+	if (fe->n > 0)
+		fe->heap[i] = last;
+
+	*joback = (struct job_ack) {.job = fj.job,
+				    .place = fj.place,
+				    .result = fj.result,
+				    .start = fj.job->dispatchtime,
+				    .end = fj.job->dispatchtime + fj.duration};
+
+	return 1;
+}
+
+
+/* The killed job finishes now with a failure */
+static void fake_kill(struct executor *executor, struct job *job)
+{
+	struct fakeexecutor *fe = executor->data;
+	struct fakejob fj;
+	size_t i;
+
+	for (i = 0; i < fe->n; i++) {
+		if (fe->heap[i].job == job)
+			break;
+	}
+
+	if (i == fe->n)
+		return;
+
+	fj = fe->heap[i];
+	fj.finish = fe->now;
+	fj.duration = 0;
+	fj.result = JOB_FAILURE;
+
+	/* Sift up, the finish time only decreased */
+	while (i > 0 && fakejob_before(&fj, &fe->heap[(i - 1) / 2])) {
+		fe->heap[i] = fe->heap[(i - 1) / 2];
+		i = (i - 1) / 2;
+	}
+	fe->heap[i] = fj;
+}
+
+
+static void fake_close(struct executor *executor)
+{
+	struct fakeexecutor *fe = executor->data;
+
+	free(fe->heap);
+	free(fe);
+	free(executor);
+}
+
+
+static double parse_probability(const char *name, const char *value)
+{
+	char *endptr;
+	double p = strtod(value, &endptr);
+
+	if (*endptr != 0 || !(p >= 0 && p <= 1))
+		die("Invalid %s probability for fake executor: %s\n", name,
+		    value);
+
+	return p;
+}
+
+
+/* spec is a comma separated list of seed=N, mean=SECONDS, fail=P and
+ * broken=P, or NULL for defaults */
+struct executor *fake_executor_create(const char *spec)
+{
+	struct executor *executor;
+	struct fakeexecutor *fe;
+	char *copy = NULL;
+	char *item, *value, *saveptr, *endptr;
+
+	executor = calloc(1, sizeof executor[0]);
+	fe = calloc(1, sizeof fe[0]);
+	if (executor == NULL || fe == NULL)
+		die("No memory for executor\n");
+
+	fe->rngstate = 1;
+	fe->mean = 1.0;
+
+	if (spec != NULL) {
+		copy = strdup(spec);
+		if (copy == NULL)
+			die("No memory for executor\n");
+	}
+
+	for (item = (copy != NULL) ? strtok_r(copy, ",", &saveptr) : NULL;
+	     item != NULL; item = strtok_r(NULL, ",", &saveptr)) {
+		value = strchr(item, '=');
+		if (value == NULL)
+			die("Invalid fake executor parameter: %s\n", item);
+		*value++ = 0;
+
+		if (strcmp(item, "seed") == 0) {
+			fe->rngstate = strtoull(value, &endptr, 10);
+			if (*endptr != 0 || fe->rngstate == 0)
+				die("Invalid seed for fake executor: %s\n",
+				    value);
+		} else if (strcmp(item, "mean") == 0) {
+			fe->mean = strtod(value, &endptr);
+			if (*endptr != 0 || !(fe->mean >= 0))
+				die("Invalid mean duration for fake executor: %s\n",
+				    value);
+		} else if (strcmp(item, "fail") == 0) {
+			fe->pfail = parse_probability(item, value);
+		} else if (strcmp(item, "broken") == 0) {
+			fe->pbroken = parse_probability(item, value);
+		} else {
+			die("Unknown fake executor parameter: %s\n", item);
+		}
+	}
+
+	free(copy);
+
+	if (fe->pfail + fe->pbroken > 1)
+		die("Fake executor failure probabilities exceed 1\n");
+
+	*executor = (struct executor) {.start = fake_start,
+				       .wait = fake_wait,
+				       .kill = fake_kill,
+				       .close = fake_close,
+				       .data = fe};
+
+	return executor;
+}
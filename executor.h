@@ -0,0 +1,35 @@
+#ifndef _JOBQUEUE_EXECUTOR_H_
+#define _JOBQUEUE_EXECUTOR_H_
+
+#include "schedule.h"
+
+/* An executor runs jobs for the scheduler. The process executor runs each
+ * job in a forked runner process. The fake executor runs nothing: jobs
+ * finish after a synthetic duration, which makes the cost of the scheduler
+ * itself measurable.
+ */
+struct executor {
+	/* Start a job on an execution place. The executor reports the
+	 * result later through wait(). */
+	void (*start)(struct executor *executor, struct job *job, int place);
+
+	/* Wait at most timeout milliseconds (forever if timeout < 0) for a
+	 * job to finish. Returns 1 and fills joback if a job finished, and
+	 * 0 on timeout or if a signal interrupted the wait. */
+	int (*wait)(struct executor *executor, struct job_ack *joback,
+		    int timeout);
+
+	/* Kill a running job. The job is still reported through wait(),
+	 * with result JOB_FAILURE unless it finished before it was
+	 * killed. */
+	void (*kill)(struct executor *executor, struct job *job);
+
+	void (*close)(struct executor *executor);
+
+	void *data;
+};
+
+struct executor *process_executor_create(void);
+struct executor *fake_executor_create(const char *spec);
+
+#endif
@@ -0,0 +1,204 @@
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "jobqueue.h"
+#include "jobcount.h"
+#include "support.h"
+
+/* Count jobs in job files for ETA computation. Job files are mmap()ed and
+ * scanned for newlines in a background thread, so that dispatching jobs is
+ * not delayed. A line is counted if useful_line() would accept it. Counting
+ * is only possible for regular files. Nothing is counted if any job file
+ * is not a regular file.
+ */
+
+static char **countfnames;
+static int ncountfiles;
+
+/* Number of jobs, or 0 if counting has not finished or is not possible */
+static size_t jobcount;
+
+
+/* Same rules as useful_line(): not empty, not a comment and not all
+ * whitespace */
+static int useful_line_at(const char *data, size_t i, size_t size)
+{
+	if (data[i] == '#')
+		return 0;
+
+	for (; i < size && data[i] != '\n'; i++) {
+		if (!isspace((unsigned char) data[i]))
+			return 1;
+	}
+
+	return 0;
+}
+
+
+#ifdef __SSE2__
+/* Bit i is set if data[i] is a newline, for 0 <= i < 64 */
+static uint64_t newline_mask(const char *data)
+{
+	const __m128i nl = _mm_set1_epi8('\n');
+	uint64_t mask = 0;
+	__m128i v;
+	int i;
+
+	for (i = 0; i < 64; i += 16) {
+		v = _mm_loadu_si128((const __m128i *) (data + i));
+		mask |= (uint64_t) _mm_movemask_epi8(_mm_cmpeq_epi8(v, nl)) << i;
+	}
+
+	return mask;
+}
+#endif
+
+
+static size_t count_useful_lines(const char *data, size_t size)
+{
+	const char *p;
+	size_t n = 0;
+	size_t i = 0;
+	size_t pos;
+
+	if (size == 0)
+		return 0;
+
+	n += useful_line_at(data, 0, size);
+
+#ifdef __SSE2__
+	/* Find newlines 64 bytes at a time. Most lines are useful, and
+	   the first character of a line decides it. */
+	uint64_t mask;
+
+	for (; i + 64 <= size; i += 64) {
+		mask = newline_mask(data + i);
+
+		while (mask) {
+			pos = i + __builtin_ctzll(mask) + 1;
+			if (pos < size)
+				n += useful_line_at(data, pos, size);
+			mask &= mask - 1;
+		}
+	}
+#endif
+
+	while ((p = memchr(data + i, '\n', size - i)) != NULL) {
+		i = p - data + 1;
+		if (i < size)
+			n += useful_line_at(data, i, size);
+	}
+
+	return n;
+}
+
+
+/* Returns 0 on success, -1 if the file can not be counted */
+static int count_file(const char *fname, size_t *n)
+{
+	struct stat st;
+	void *map;
+	int fd;
+
+	fd = open(fname, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+
+	if (fstat(fd, &st) || !S_ISREG(st.st_mode)) {
+		close(fd);
+		return -1;
+	}
+
+	if (st.st_size == 0) {
+		close(fd);
+		return 0;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return -1;
+
+	madvise(map, st.st_size, MADV_SEQUENTIAL | MADV_WILLNEED);
+
+	*n += count_useful_lines(map, st.st_size);
+
+	munmap(map, st.st_size);
+
+	return 0;
+}
+
+
+static void *jobcount_thread(void *arg)
+{
+	size_t n = 0;
+	int i;
+
+	for (i = 0; i < ncountfiles; i++) {
+		if (count_file(countfnames[i], &n))
+			return NULL;
+	}
+
+	if (VERBOSE)
+		fprintf(stderr, "Counted %zu jobs\n", n);
+
+	__atomic_store_n(&jobcount, n, __ATOMIC_RELEASE);
+
+	return NULL;
+}
+
+
+void jobcount_start(char *fnames[], int nfiles)
+{
+	static char *stdinname = "/dev/stdin";
+	pthread_t thread;
+	pthread_attr_t attr;
+	sigset_t allsignals, oldmask;
+	int ret;
+
+	if (nfiles > 0) {
+		countfnames = fnames;
+		ncountfiles = nfiles;
+	} else {
+		/* Stdin can be counted if it is redirected from a file */
+		countfnames = &stdinname;
+		ncountfiles = 1;
+	}
+
+	/* The counting thread must not take signals that belong to the
+	   scheduler, such as SIGCHLD */
+	sigfillset(&allsignals);
+	pthread_sigmask(SIG_SETMASK, &allsignals, &oldmask);
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	ret = pthread_create(&thread, &attr, jobcount_thread, NULL);
+	pthread_attr_destroy(&attr);
+
+	pthread_sigmask(SIG_SETMASK, &oldmask, NULL);
+
+	if (ret)
+		fprintf(stderr, "Can not count jobs: %s\n", strerror(ret));
+}
+
+
+size_t jobcount_result(void)
+{
+	return __atomic_load_n(&jobcount, __ATOMIC_ACQUIRE);
+}
@@ -0,0 +1,9 @@
+#ifndef _JOBQUEUE_JOBCOUNT_H_
+#define _JOBQUEUE_JOBCOUNT_H_
+
+#include <stddef.h>
+
+void jobcount_start(char *fnames[], int nfiles);
+size_t jobcount_result(void);
+
+#endif
@@ -19,26 +19,112 @@
 #include <ctype.h>
 
 #include "version.h"
+#include "eventlog.h"
+#include "jobcount.h"
 #include "jobqueue.h"
+#include "replay.h"
 #include "schedule.h"
+#include "shmstats.h"
 #include "support.h"
 
 struct vplist machinelist = VPLIST_INITIALIZER;
 
+/* Tune maxissue of each execution place between adaptivemin and
+ * adaptivemax at runtime if adaptivemax != 0 */
+int adaptivemin;
+int adaptivemax;
+
+/* A job with an affinity key waits at most affinitydelay ns for the
+ * execution place that last ran the key */
+uint64_t affinitydelay = 5000000000ULL;
+
+/* Hold jobs while memory is short if admission != 0. admissionspec holds
+ * the thresholds, or NULL. */
+int admission;
+const char *admissionspec;
+
 /* Pass an execution place id parameter for each job if
  * passexecutionplace != 0 */
 int passexecutionplace;
 
+/* Pin local jobs to cores or NUMA nodes as described by pinspec, if it is
+ * not NULL */
+const char *pinspec;
+
 int requeuefailedjobs;
 
+/* Probe broken execution places after a backoff and put them back in use
+ * if recoverplaces != 0. recoverspec holds the backoff parameters, or
+ * NULL. A place is probed with probecommand if it is not NULL, and
+ * otherwise with the next job. */
+int recoverplaces;
+const char *recoverspec;
+const char *probecommand;
+
 int verbosemode;
 
 size_t compute_eta_jobs;
 
+/* Finished jobs are recorded into journalfile, if it is not NULL. If
+ * resumejournal != 0, jobs already recorded in the journal are skipped. */
+const char *journalfile;
+int resumejournal;
+
+/* Successful jobs are recorded into cachefile, if it is not NULL, and jobs
+ * found in the cache are not executed again. If cacheinputs != 0, cache
+ * keys also depend on files named in commands. */
+const char *cachefile;
+int cacheinputs;
+
+/* Print a run summary if printsummary != 0. Write a line for each job
+ * execution into resultsfile if it is not NULL. */
+int printsummary;
+const char *resultsfile;
+
+/* Show a progress line on stderr if showprogress != 0 and stderr is a
+ * terminal */
+int showprogress;
+
+/* Keep a ring of recent scheduler events, and write it into eventlogfile
+ * on SIGUSR2 and at exit if eventlogfile is not NULL */
+const char *eventlogfile;
+
+/* Use the fake executor instead of running jobs if fakeexecutor != 0.
+ * fakeexecutorspec holds its parameters, or NULL. */
+int fakeexecutor;
+const char *fakeexecutorspec;
+
+/* Write Prometheus metrics into metricsfile periodically if it is not NULL */
+const char *metricsfile;
+
+/* Report time spent in each scheduler phase if selfprofiling != 0 */
+int selfprofiling;
+
+/* Publish counters in /dev/shm/jobqueue.<pid> if publishshmstats != 0 */
+int publishshmstats;
+
+/* Start a copy of a job that runs longer than speculatefactor times the
+ * median duration when no other jobs are left, if speculatefactor > 0 */
+double speculatefactor;
+
+/* Write an execution trace into tracefile if it is not NULL */
+const char *tracefile;
+
+/* Time limit of each job execution in ns, or 0 */
+uint64_t jobtimeout;
+
 static const char *USAGE =
 "\n"
 "SYNTAX:\n"
-"\tjobqueue [-c x] [-e] [-n x] [-m list] [--max-restart=x] [-r] [-v]\n"
+"\tjobqueue [--adaptive=min:max] [--admission[=spec]]\n"
+"\t         [--affinity-delay=seconds] [--cache=file] [--cache-inputs]\n"
+"\t         [-c x|auto] [--decode-events=file] [-e]\n"
+"\t         [--event-log=file] [--fake-executor[=spec]] [--journal=file]\n"
+"\t         [-n x] [-m list] [--max-restart=x] [--metrics-file=file] [-p]\n"
+"\t         [--pin=core|numa[,mem=bind|preferred]] [--probe=cmd] [-r]\n"
+"\t         [--recover[=spec]] [--replay=file] [--results=file]\n"
+"\t         [--resume=file] [--self-profile] [--shm-stats] [--speculate[=k]]\n"
+"\t         [--stat=pid] [--summary] [--timeout=seconds] [--trace=file] [-v]\n"
 "\t         [--version] [-x n] [FILE ...]\n"
 "\n"
 "jobqueue is a tool for executing lists of jobs on several processors or\n"
@@ -46,8 +132,56 @@ static const char *USAGE =
 "files are given, jobqueue reads jobs from stdin. Each job is executed in a\n"
 "shell environment (man 3 system).\n"
 "\n"
+" --adaptive=min:max, tune the number of simultaneously running jobs of\n"
+"    each execution place between min and max while jobs run. The limit\n"
+"    starts from the -x or machine list value, and it is moved one step at a\n"
+"    time in the direction that increases completed jobs per second on the\n"
+"    place. A step is taken after each measurement period of at least one\n"
+"    second and twice the current limit of completed jobs. Tuning stops\n"
+"    when all jobs have been started.\n"
+"\n"
+" --admission[=spec], do not start a job while memory is short. A job is\n"
+"    held while MemAvailable in /proc/meminfo, less the memory hint of the\n"
+"    job, is below a reserve, or while memory pressure (\"some avg10\" in\n"
+"    /proc/pressure/memory) is above a limit. Memory is checked again five\n"
+"    times a second. A job is always started if no jobs are running.\n"
+"    spec is a comma separated list of parameters: mem=SIZE (the reserve,\n"
+"    default 10 % of MemTotal) and psi=PERCENT (default 10). SIZE may have\n"
+"    a K, M, G or T suffix.\n"
+"\n"
+"    A memory hint is given as a job attribute in brackets before the\n"
+"    command, for example: [mem=4G] ./simulate input1\n"
+"    Hints of jobs started during the last 5 seconds are also subtracted\n"
+"    from MemAvailable, because new jobs have not allocated their memory\n"
+"    yet.\n"
+"\n"
+" --affinity-delay=seconds, a job with an affinity key attribute (see\n"
+"    --admission), for example [affinity=shard7] ./process shard7, is\n"
+"    started on the execution place that last started a job with the same\n"
+"    key, if that place has a free slot. If the place is full, the job\n"
+"    waits for it for at most the given time (default 5), while other jobs\n"
+"    are started, and then runs on any free place. At most as many jobs\n"
+"    wait as there are slots in all places. 0 disables waiting.\n"
+"\n"
+" --cache=file, use file as a result cache. A job that has succeeded before\n"
+"    with exactly the same command line is not executed again, but it is\n"
+"    counted as done. The execution place is not part of the command line\n"
+"    in this respect. The cache file is created if it does not exist.\n"
+"    A cache file must not be used by two jobqueue instances at once.\n"
+"\n"
+" --cache-inputs, with --cache, each command argument that names an existing\n"
+"    file also makes the size and modification time of that file a part of\n"
+"    the cached command. Changing an input file makes the job run again.\n"
+"\n"
 " -c x / --compute-eta=x, The total number of jobs is x. Compute ETA during\n"
-"                         execution.\n"
+"    execution. ETA is based on moving averages of job execution times on\n"
+"    each execution place, and is printed with the completion rate and an\n"
+"    approximate 95 % confidence interval.\n"
+"    If x is \"auto\", jobs are counted from job files in the background, and\n"
+"    ETA is shown when counting is done. Counting requires regular files.\n"
+"\n"
+" --decode-events=file, print an event log written with --event-log as\n"
+"    text, and exit.\n"
 "\n"
 " -e / --execution-place, each job is executed by passing an execution place id\n"
 "    as a parameter. The execution place defines a virtual execution place for\n"
@@ -56,6 +190,27 @@ static const char *USAGE =
 "    If command \"foo\" is executed from a job list, jobqueue executes \"foo x\",\n"
 "    where x is the execution place id.\n"
 "\n"
+" --event-log=file, keep the last 65536 scheduler events (job dispatch, job\n"
+"    completion, retry, timeout, broken execution place, end of job list)\n"
+"    with nanosecond timestamps in a memory ring. The ring is written into\n"
+"    the given file when jobqueue receives SIGUSR2, when it exits and when\n"
+"    it dies on an error. Recording an event costs a clock read and a few\n"
+"    stores, so the log can always be enabled.\n"
+"\n"
+" --fake-executor[=spec], do not execute jobs. Each job finishes after a\n"
+"    random duration from an exponential distribution, with a random result.\n"
+"    This measures the cost of the scheduler itself. spec is a comma\n"
+"    separated list of parameters: seed=N (random seed, default 1),\n"
+"    mean=SECONDS (mean job duration, default 1), fail=P (probability of\n"
+"    result 1, a failed job, default 0) and broken=P (probability of result\n"
+"    2, a broken execution place, default 0). Runs are deterministic for a\n"
+"    given seed. Job durations are simulated, and no time is spent waiting.\n"
+"    May not be used with --cache or --journal.\n"
+"\n"
+" --journal=file, append a record of each finished job to the given file.\n"
+"    Records are synced to disk at most once a second. If jobqueue or the\n"
+"    machine dies, the run can be continued with --resume=file.\n"
+"\n"
 " -m list / --machine-list=list, read contents of list file, and count each\n"
 "    non-empty and non-comment line to be an execution place. Pass execution\n"
 "    place for each executed job as a parameter. The execution place is usually\n"
@@ -71,15 +226,127 @@ static const char *USAGE =
 " --max-restart=x, implies -r / --restart-failed, but sets the maximum number\n"
 "    of restarts for each job\n"
 "\n"
+" --metrics-file=file, write metrics in the Prometheus text format into the\n"
+"    given file every 5 seconds and when all jobs are done, for example for\n"
+"    the textfile collector of node_exporter. The file is replaced atomically\n"
+"    by renaming file.tmp over it. Metrics include started, succeeded,\n"
+"    failed (by exit class) and retried jobs, a job duration histogram, and\n"
+"    running jobs, capacity and broken state of each execution place.\n"
+"\n"
 " -n x / --nodes=x, jobqueue keeps at most x jobs running in parallel.\n"
-"    Jobqueue issues new jobs as older jobs are finished.\n"
+"    Jobqueue issues new jobs as older jobs are finished. If none of -n, -m,\n"
+"    -e and -x is given, jobqueue keeps as many jobs running as there are\n"
+"    processors in /proc/cpuinfo. Processors are logical CPUs, so each\n"
+"    hardware thread of a core counts. With -e and without -n, one job runs\n"
+"    at a time, as the place id of each job is 1.\n"
+"\n"
+" -p / --progress, show a status line with the number of finished, running,\n"
+"    failed and requeued jobs, the job rate, ETA (see -c) and running jobs\n"
+"    on each execution place. The line is redrawn five times a second. It is\n"
+"    only shown if stderr is a terminal.\n"
+"\n"
+" --recover[=spec], probe a broken execution place (see -r) again after a\n"
+"    backoff, and put it back in use if it works. Unless --probe is given,\n"
+"    the place is probed by starting the next job on it, and it works if\n"
+"    that job does not exit with 2 and does not time out (see --timeout).\n"
+"    The backoff doubles after each failed probe and each time a restored\n"
+"    place breaks again, up to a maximum. spec is a comma separated list of\n"
+"    parameters: backoff=SECONDS (the first backoff, default 30) and\n"
+"    max=SECONDS (default 900). jobqueue does not give up when all\n"
+"    execution places are broken, but waits for them to recover.\n"
+"\n"
+" --replay=file, predict the wall time of a run from a results file written\n"
+"    with --results, and exit. Recorded executions, including retries, are\n"
+"    replayed in virtual time on the execution places and slots given with\n"
+"    -n, -m and -x, with jobs issued in job file order (fifo), longest job\n"
+"    first and shortest job first. For each order, the predicted makespan,\n"
+"    slot utilization and speedup over the recorded run are printed. A job\n"
+"    occupies a slot from its dispatch to its end, and all slots are\n"
+"    assumed to be equally fast. No jobs are executed.\n"
+"\n"
+" --pin=core|numa[,mem=bind|preferred], pin each job to one CPU core (all\n"
+"    hardware threads of the core) or to the CPUs of one NUMA node, as\n"
+"    described in /sys/devices/system. Only CPUs that jobqueue is allowed\n"
+"    to run on are used. Slots of all execution places are numbered in\n"
+"    order, and the job in slot i gets core or node i modulo the number of\n"
+"    cores or nodes. With -n x, each place has one slot, and place i gets\n"
+"    core or node i. mem=bind restricts the memory of the job to the NUMA\n"
+"    node of its CPUs, and mem=preferred allocates memory from that node\n"
+"    when possible. May not be used with -m.\n"
+"\n"
+"    Each job gets the execution place id and the slot number within the\n"
+"    place (both from 1) in environment variables JOBQUEUE_PLACE and\n"
+"    JOBQUEUE_SLOT, with or without --pin.\n"
+"\n"
+" --probe=cmd, implies --recover, and probes a broken execution place by\n"
+"    running cmd on it like a job, with the execution place as a parameter\n"
+"    if -e or -m is given. The place is put back in use if cmd exits with\n"
+"    0. Probes that still run when all jobs are done are killed. cmd should\n"
+"    limit its own run time, for example: --probe='ping -c 1 -W 5'\n"
 "\n"
 " -r / --restart-failed, if a job that is executed returns an error code, it is\n"
 "    restarted (on some execution place). If the error code is 1, the\n"
 "    job simply failed and it is restarted. If the error code is 2, the\n"
 "    execution place is marked as being failed, and thus, no additional jobs\n"
-"    will be started on that node. WARNING: There is no limit for maximum\n"
-"    number of restarts unless --max-restart is used.\n"
+"    will be started on that node (but see --recover). WARNING: There is no\n"
+"    limit for maximum number of restarts unless --max-restart is used.\n"
+"\n"
+" --results=file, write a CSV line for each job execution into the given file.\n"
+"    Columns are: job number, execution place id (from 1), result (0 =\n"
+"    success, 1 = failure, 2 = broken execution place), number of earlier\n"
+"    executions, dispatch, start and end times (seconds from the start of\n"
+"    the run), user and system CPU seconds, maximum RSS (kB), minor and\n"
+"    major page faults, and the command.\n"
+"\n"
+" --resume=file, continue a run that was started with --journal=file. Jobs\n"
+"    that were finished according to the journal are skipped, and jobs that\n"
+"    were running are executed again. New records are appended to the same\n"
+"    journal. The same job files must be given in the same order. If the\n"
+"    journal does not exist, all jobs are executed.\n"
+"\n"
+" --self-profile, measure time that the scheduler spends in each phase:\n"
+"    reading job lines, journal and cache checks, job allocation, starting\n"
+"    jobs (fork()), waiting for jobs, handling finished jobs and periodic\n"
+"    output. Print the breakdown, the overhead per dispatched job, and the\n"
+"    maximum dispatch rate that the overhead allows to stderr after all\n"
+"    jobs are done.\n"
+"\n"
+" --shm-stats, publish counters of the run in /dev/shm/jobqueue.<pid>: jobs\n"
+"    read, done, failed, requeued and running, running jobs and broken\n"
+"    state of each execution place, and the latest ETA (see -c). The file is\n"
+"    removed when jobqueue exits. Updates are plain memory writes protected\n"
+"    by a sequence lock, so monitors can read the file at any time.\n"
+"\n"
+" --speculate[=k], when all jobs have been started, start a copy of each job\n"
+"    that has run longer than k times the median job duration (default\n"
+"    3) on a free execution place, preferably on another place. The first\n"
+"    copy to succeed wins, and the other copy is killed. If one copy\n"
+"    fails, the other one decides the result. Only the winning copy is\n"
+"    counted in results, statistics, retries, the journal and the cache.\n"
+"    Jobs must tolerate running twice at the same time.\n"
+"\n"
+" --stat=pid, print counters published by jobqueue process pid with\n"
+"    --shm-stats, and exit.\n"
+"\n"
+" --summary, print a summary to stderr after all jobs are done: job duration\n"
+"    percentiles, slowest jobs, scheduler busy and idle time, and\n"
+"    throughput and resource usage of each execution place.\n"
+"\n"
+" --timeout=seconds, kill a job execution that runs longer than the given\n"
+"    time, with all processes in its process group. A killed job fails.\n"
+"    With -r, it is requeued, and it is started on another execution place\n"
+"    if there is one, and a place where 3 jobs in a row time out is marked\n"
+"    broken. A job can have a time limit of its own as a job attribute\n"
+"    (see --admission): [timeout=600] ./simulate input1\n"
+"\n"
+"    A job that has a time limit, and any job with --speculate, runs in a\n"
+"    process group of its own, so that it can be killed with its children.\n"
+"    Such a job can not read from the terminal.\n"
+"\n"
+" --trace=file, write an execution trace in Chrome trace event format into\n"
+"    the given file. It can be viewed with chrome://tracing or Perfetto.\n"
+"    Each slot of each execution place is a track, and each job execution\n"
+"    is a span on a track. Retries and broken places are marked.\n"
 "\n"
 " -v / --verbose, enter verbose mode. Print each command that is executed.\n"
 "\n"
@@ -222,23 +489,6 @@ static int read_machine_list(const char *fname)
 }
 
 
-static void trivial_sigchld(int signum)
-{
-	while (waitpid(-1, NULL, WNOHANG) > 0);
-}
-
-
-static void setup_child_handler(void)
-{
-	struct sigaction act = (struct sigaction) {
-		.sa_handler = trivial_sigchld,
-		.sa_flags = SA_NOCLDSTOP};
-
-	if (sigaction(SIGCHLD, &act, NULL) < 0)
-		die("Can not install child handler: %s\n", strerror(errno));
-}
-
-
 int main(int argc, char *argv[])
 {
 	int ret;
@@ -248,64 +498,170 @@ int main(int argc, char *argv[])
 	char *endptr;
 	struct jobqueue *queue;
 	int taskgraphmode = 0;
+	int countjobs = 0;
+	const char *replayfile = NULL;
 	int maxissue = -1;
 	long njobs;
+	char c;
+	double timeout;
+	double delay;
 
 	enum jobqueueoptions {
+		OPT_ADAPTIVE        = 1017,
+		OPT_ADMISSION       = 1018,
+		OPT_AFFINITY_DELAY  = 1024,
+		OPT_CACHE           = 1004,
+		OPT_CACHE_INPUTS    = 1005,
 		OPT_COMPUTE_ETA     = 'c',
+		OPT_DECODE_EVENTS   = 1012,
+		OPT_EVENT_LOG       = 1013,
 		OPT_EXECUTION_PLACE = 'e',
+		OPT_FAKE_EXECUTOR   = 1015,
 		OPT_HELP            = 'h',
+		OPT_JOURNAL         = 1002,
 		OPT_MACHINE_LIST    = 'm',
 		OPT_MAX_RESTART     = 1000,
+		OPT_METRICS_FILE    = 1011,
 		OPT_NODES           = 'n',
+		OPT_PIN             = 1019,
+		OPT_PROBE           = 1022,
+		OPT_PROGRESS        = 'p',
+		OPT_RECOVER         = 1023,
+		OPT_REPLAY          = 1016,
 		OPT_RESTART_FAILED  = 'r',
+		OPT_RESULTS         = 1006,
+		OPT_RESUME          = 1003,
+		OPT_SELF_PROFILE    = 1014,
+		OPT_SHM_STATS       = 1009,
+		OPT_SPECULATE       = 1020,
+		OPT_STAT            = 1010,
+		OPT_SUMMARY         = 1007,
 		OPT_MAX_ISSUE       = 'x',
 		OPT_TASK_GRAPH      = 't',
+		OPT_TIMEOUT         = 1021,
+		OPT_TRACE           = 1008,
 		OPT_VERBOSE         = 'v',
 		OPT_VERSION         = 1001,
 	};
 
 	const struct option longopts[] = {
+		{.name = "adaptive",        .has_arg = 1, .val = OPT_ADAPTIVE},
+		{.name = "admission",       .has_arg = 2, .val = OPT_ADMISSION},
+		{.name = "affinity-delay",  .has_arg = 1, .val = OPT_AFFINITY_DELAY},
+		{.name = "cache",           .has_arg = 1, .val = OPT_CACHE},
+		{.name = "cache-inputs",    .has_arg = 0, .val = OPT_CACHE_INPUTS},
 		{.name = "compute-eta",     .has_arg = 1, .val = OPT_COMPUTE_ETA},
+		{.name = "decode-events",   .has_arg = 1, .val = OPT_DECODE_EVENTS},
+		{.name = "event-log",       .has_arg = 1, .val = OPT_EVENT_LOG},
 		{.name = "execution-place", .has_arg = 0, .val = OPT_EXECUTION_PLACE},
+		{.name = "fake-executor",   .has_arg = 2, .val = OPT_FAKE_EXECUTOR},
 		{.name = "help",            .has_arg = 0, .val = OPT_HELP},
+		{.name = "journal",         .has_arg = 1, .val = OPT_JOURNAL},
 		{.name = "machine-list",    .has_arg = 1, .val = OPT_MACHINE_LIST},
 		{.name = "max-issue",       .has_arg = 1, .val = OPT_MAX_ISSUE},
 		{.name = "max-restart",     .has_arg = 1, .val = OPT_MAX_RESTART},
+		{.name = "metrics-file",    .has_arg = 1, .val = OPT_METRICS_FILE},
 		{.name = "nodes",           .has_arg = 1, .val = OPT_NODES},
+		{.name = "pin",             .has_arg = 1, .val = OPT_PIN},
+		{.name = "probe",           .has_arg = 1, .val = OPT_PROBE},
+		{.name = "progress",        .has_arg = 0, .val = OPT_PROGRESS},
+		{.name = "recover",         .has_arg = 2, .val = OPT_RECOVER},
+		{.name = "replay",          .has_arg = 1, .val = OPT_REPLAY},
 		{.name = "restart-failed",  .has_arg = 0, .val = OPT_RESTART_FAILED},
+		{.name = "results",         .has_arg = 1, .val = OPT_RESULTS},
+		{.name = "resume",          .has_arg = 1, .val = OPT_RESUME},
+		{.name = "self-profile",    .has_arg = 0, .val = OPT_SELF_PROFILE},
+		{.name = "shm-stats",       .has_arg = 0, .val = OPT_SHM_STATS},
+		{.name = "speculate",       .has_arg = 2, .val = OPT_SPECULATE},
+		{.name = "stat",            .has_arg = 1, .val = OPT_STAT},
+		{.name = "summary",         .has_arg = 0, .val = OPT_SUMMARY},
 		{.name = "task-graph",      .has_arg = 0, .val = OPT_TASK_GRAPH},
+		{.name = "timeout",         .has_arg = 1, .val = OPT_TIMEOUT},
+		{.name = "trace",           .has_arg = 1, .val = OPT_TRACE},
 		{.name = "verbose",         .has_arg = 0, .val = OPT_VERBOSE},
 		{.name = "version",         .has_arg = 0, .val = OPT_VERSION},
 		{.name = NULL}};
 
-	setup_child_handler();
 	
 	while (1) {
-		ret = getopt_long(argc, argv, "c:ehm:n:rtvx:", longopts, NULL);
+		ret = getopt_long(argc, argv, "c:ehm:n:prtvx:", longopts, NULL);
 		if (ret == -1)
 			break;
 
 		switch (ret) {
+		case OPT_ADAPTIVE:
+			if (sscanf(optarg, "%d:%d%c", &adaptivemin, &adaptivemax,
+				   &c) != 2 || adaptivemin <= 0 ||
+			    adaptivemax < adaptivemin)
+				die("Invalid parameter: --adaptive=%s\n", optarg);
+			break;
+
+		case OPT_ADMISSION:
+			admission = 1;
+			admissionspec = optarg;
+			break;
+
+		case OPT_AFFINITY_DELAY:
+			delay = strtod(optarg, &endptr);
+			if (!(delay >= 0) || *endptr != 0)
+				die("Invalid parameter: --affinity-delay=%s\n",
+				    optarg);
+			affinitydelay = delay * 1000000000.0;
+			break;
+
+		case OPT_CACHE:
+			cachefile = optarg;
+			break;
+
+		case OPT_CACHE_INPUTS:
+			cacheinputs = 1;
+			break;
+
 		case OPT_COMPUTE_ETA:
+			if (strcmp(optarg, "auto") == 0) {
+				countjobs = 1;
+				compute_eta_jobs = 0;
+				break;
+			}
 			njobs = strtol(optarg, &endptr, 10);
 			if (njobs < 0 || *endptr != 0)
 				die("Invalid number of jobs: %s\n", optarg);
 			compute_eta_jobs = njobs;
+			countjobs = 0;
+			break;
+
+		case OPT_DECODE_EVENTS:
+			exit(eventlog_decode(optarg));
+
+		case OPT_EVENT_LOG:
+			eventlogfile = optarg;
 			break;
 
 		case OPT_EXECUTION_PLACE:
 			passexecutionplace = 1;
 			break;
 
+		case OPT_FAKE_EXECUTOR:
+			fakeexecutor = 1;
+			fakeexecutorspec = optarg;
+			break;
+
 		case OPT_HELP:
 			print_help();
 			exit(0);
 
+		case OPT_JOURNAL:
+			journalfile = optarg;
+			break;
+
 		case OPT_MACHINE_LIST:
 			nplaces = read_machine_list(optarg);
 			break;
 
+		case OPT_METRICS_FILE:
+			metricsfile = optarg;
+			break;
+
 		case OPT_NODES:
 			l = strtol(optarg, &endptr, 10);
 
@@ -317,15 +673,85 @@ int main(int argc, char *argv[])
 			nplacespassed = 1;
 			break;
 
+		case OPT_PIN:
+			pinspec = optarg;
+			break;
+
+		case OPT_PROBE:
+			probecommand = optarg;
+			recoverplaces = 1;
+			break;
+
+		case OPT_PROGRESS:
+			showprogress = 1;
+			break;
+
+		case OPT_RECOVER:
+			recoverspec = optarg;
+			recoverplaces = 1;
+			break;
+
+		case OPT_REPLAY:
+			replayfile = optarg;
+			break;
+
 		case OPT_RESTART_FAILED:
 			if (!requeuefailedjobs)
 				requeuefailedjobs = INT_MAX;
 			break;
 
+		case OPT_RESULTS:
+			resultsfile = optarg;
+			break;
+
+		case OPT_RESUME:
+			journalfile = optarg;
+			resumejournal = 1;
+			break;
+
+		case OPT_SELF_PROFILE:
+			selfprofiling = 1;
+			break;
+
+		case OPT_SHM_STATS:
+			publishshmstats = 1;
+			break;
+
+		case OPT_SPECULATE:
+			speculatefactor = 3.0;
+			if (optarg == NULL)
+				break;
+
+			speculatefactor = strtod(optarg, &endptr);
+			if (!(speculatefactor > 1) || *endptr != 0)
+				die("Invalid parameter: --speculate=%s\n", optarg);
+			break;
+
+		case OPT_STAT:
+			l = strtol(optarg, &endptr, 10);
+			if (l <= 0 || *endptr != 0)
+				die("Invalid pid: %s\n", optarg);
+			exit(shmstats_print(l));
+
+		case OPT_SUMMARY:
+			printsummary = 1;
+			break;
+
 		case OPT_TASK_GRAPH:
 			taskgraphmode = 1;
 			break;
 
+		case OPT_TIMEOUT:
+			timeout = strtod(optarg, &endptr);
+			if (!(timeout > 0) || *endptr != 0)
+				die("Invalid parameter: --timeout=%s\n", optarg);
+			jobtimeout = timeout * 1000000000.0;
+			break;
+
+		case OPT_TRACE:
+			tracefile = optarg;
+			break;
+
 		case OPT_VERBOSE:
 			verbosemode = 1;
 			break;
@@ -361,8 +787,28 @@ int main(int argc, char *argv[])
 	    (nplacespassed && machinelist.next != NULL))
 		die("Error: -m MACHINELIST may not be used with -e and -n\n");
 
+	/* Jobs on a machine list run elsewhere */
+	if (pinspec != NULL && machinelist.next != NULL)
+		die("Error: --pin may not be used with -m MACHINELIST\n");
+
+	/* Keep each processor busy by default. With -e, the only place id is 1,
+	   and jobs that share it must not run at once. */
+	if (!nplacespassed && !passexecutionplace &&
+	    vplist_is_empty(&machinelist) && maxissue == -1)
+		maxissue = cpuinfo_processors();
+
+	if (replayfile != NULL)
+		return replay(replayfile, nplaces, maxissue);
+
+	/* Jobs that the fake executor "finishes" must not be recorded */
+	if (fakeexecutor && (cachefile != NULL || journalfile != NULL))
+		die("--fake-executor may not be used with --cache or --journal\n");
+
 	queue = init_queue(argv, optind, argc, taskgraphmode);
 
+	if (countjobs && !taskgraphmode)
+		jobcount_start(argv + optind, argc - optind);
+
 	schedule(nplaces, queue, maxissue);
 
 	return 0;
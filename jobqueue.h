@@ -2,6 +2,7 @@
 #define _JOBQUEUE_H_
 
 #include <stdio.h>
+#include <stdint.h>
 #include "vplist.h"
 
 struct machine {
@@ -13,9 +14,34 @@ struct machine {
 
 extern struct vplist machinelist;
 extern int maxissue;
+extern int adaptivemin;
+extern int adaptivemax;
+extern uint64_t affinitydelay;
+extern int admission;
+extern const char *admissionspec;
 extern int requeuefailedjobs;
+extern int recoverplaces;
+extern const char *recoverspec;
+extern const char *probecommand;
 extern int passexecutionplace;
+extern const char *pinspec;
 extern int verbosemode;
 extern size_t compute_eta_jobs;
+extern const char *journalfile;
+extern int resumejournal;
+extern const char *cachefile;
+extern int cacheinputs;
+extern int printsummary;
+extern const char *resultsfile;
+extern int showprogress;
+extern const char *eventlogfile;
+extern int fakeexecutor;
+extern const char *fakeexecutorspec;
+extern const char *metricsfile;
+extern int selfprofiling;
+extern int publishshmstats;
+extern double speculatefactor;
+extern const char *tracefile;
+extern uint64_t jobtimeout;
 
 #endif
@@ -0,0 +1,243 @@
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "jobqueue.h"
+#include "journal.h"
+#include "support.h"
+
+/* The journal is a text file with one line per finished job:
+ *
+ * jobnumber fileindex offset result
+ *
+ * fileindex and offset give the position right after the job line in the
+ * job files, so that a resumed run can seek directly past the longest
+ * prefix of finished jobs. Each record is written with a single write()
+ * so it survives a crash of jobqueue. fsync() is done at most once per
+ * JOURNAL_SYNC_INTERVAL seconds, and when the journal is closed.
+ */
+
+#define JOURNAL_SYNC_INTERVAL 1
+
+static int journalfd = -1;
+static time_t lastsync;
+static int unsynced;
+
+/* Bitmap of finished jobs read from the resumed journal */
+static uint8_t *donemap;
+static size_t donemapsize;
+
+
+static void mark_done(size_t jobnumber)
+{
+	size_t byte = jobnumber / 8;
+	size_t newsize;
+	uint8_t *newmap;
+
+	if (byte >= donemapsize) {
+		newsize = donemapsize ? donemapsize : 4096;
+		while (newsize <= byte)
+			newsize *= 2;
+
+		newmap = realloc(donemap, newsize);
+		if (newmap == NULL)
+			die("No memory for journal\n");
+
+		memset(newmap + donemapsize, 0, newsize - donemapsize);
+		donemap = newmap;
+		donemapsize = newsize;
+	}
+
+	donemap[byte] |= 1 << (jobnumber % 8);
+}
+
+
+int journal_is_done(size_t jobnumber)
+{
+	size_t byte = jobnumber / 8;
+
+	if (byte >= donemapsize)
+		return 0;
+
+	return (donemap[byte] >> (jobnumber % 8)) & 1;
+}
+
+
+static int parse_record(FILE *f, size_t *jobnumber, size_t *fileindex,
+			off_t *offset)
+{
+	long long off;
+	int result;
+
+	if (fscanf(f, "%zu %zu %lld %d\n", jobnumber, fileindex, &off,
+		   &result) != 4)
+		return -1;
+
+	*offset = off;
+
+	return 0;
+}
+
+
+/* Drop a partially written last record */
+static void truncate_torn_record(int fd)
+{
+	struct stat st;
+	off_t len;
+	char c;
+
+	if (fstat(fd, &st))
+		dieerror("Can not stat journal");
+
+	len = st.st_size;
+
+	while (len > 0) {
+		if (pread(fd, &c, 1, len - 1) != 1)
+			dieerror("Can not read journal");
+
+		if (c == '\n')
+			break;
+
+		len--;
+	}
+
+	if (len != st.st_size && ftruncate(fd, len))
+		dieerror("Can not truncate journal");
+}
+
+
+static size_t load_journal(const char *fname, struct jobqueue *queue)
+{
+	FILE *f;
+	size_t jobnumber, fileindex = 0;
+	off_t offset = 0;
+	size_t prefix = 0;
+	size_t nrecords = 0;
+
+	f = fopen(fname, "r");
+	if (f == NULL) {
+		/* Nothing to resume: this is the first run */
+		if (errno == ENOENT)
+			return 0;
+
+		dieerror("Can not open journal %s", fname);
+	}
+
+	while (parse_record(f, &jobnumber, &fileindex, &offset) == 0) {
+		mark_done(jobnumber);
+		nrecords++;
+	}
+
+	/* Jobs [0, prefix) are all finished */
+	while (journal_is_done(prefix))
+		prefix++;
+
+	if (prefix > 0) {
+		/* Find the position after the last job of the prefix */
+		rewind(f);
+
+		while (parse_record(f, &jobnumber, &fileindex, &offset) == 0) {
+			if (jobnumber == prefix - 1)
+				break;
+		}
+
+		if (queue->seek == NULL ||
+		    queue->seek(queue, fileindex, offset))
+			prefix = 0;
+	}
+
+	fclose(f);
+
+	if (VERBOSE)
+		fprintf(stderr, "Resuming: %zd finished jobs in journal, skipping %zd jobs directly\n",
+			nrecords, prefix);
+
+	return prefix;
+}
+
+
+/* Open a journal. If resume != 0, finished jobs are read from the journal,
+ * and new records are appended to it. Returns the number of jobs that
+ * were skipped by seeking the queue. Those jobs must be counted as read and
+ * done. Other finished jobs are found with journal_is_done().
+ */
+size_t journal_open(const char *fname, int resume, struct jobqueue *queue)
+{
+	size_t skipped = 0;
+	int flags = O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC;
+
+	if (resume)
+		skipped = load_journal(fname, queue);
+	else
+		flags |= O_TRUNC;
+
+	journalfd = open(fname, flags, 0666);
+	if (journalfd < 0)
+		dieerror("Can not open journal %s", fname);
+
+	if (resume)
+		truncate_torn_record(journalfd);
+
+	lastsync = time(NULL);
+
+	return skipped;
+}
+
+
+static void journal_sync(void)
+{
+	if (fdatasync(journalfd))
+		dieerror("Can not sync journal");
+
+	lastsync = time(NULL);
+	unsynced = 0;
+}
+
+
+void journal_record(size_t jobnumber, size_t fileindex, off_t offset,
+		    int result)
+{
+	char record[128];
+	int len;
+	ssize_t ret;
+	time_t now;
+
+	if (journalfd < 0)
+		return;
+
+	len = snprintf(record, sizeof record, "%zu %zu %lld %d\n", jobnumber,
+		       fileindex, (long long) offset, result);
+
+	ret = write(journalfd, record, len);
+	if (ret != len)
+		die("Can not write journal: %s\n",
+		    ret < 0 ? strerror(errno) : "short write");
+
+	unsynced = 1;
+
+	now = time(NULL);
+	if (now - lastsync >= JOURNAL_SYNC_INTERVAL)
+		journal_sync();
+}
+
+
+void journal_close(void)
+{
+	if (journalfd < 0)
+		return;
+
+	if (unsynced)
+		journal_sync();
+
+	close(journalfd);
+	journalfd = -1;
+}
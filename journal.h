@@ -0,0 +1,14 @@
+#ifndef _JOBQUEUE_JOURNAL_H_
+#define _JOBQUEUE_JOURNAL_H_
+
+#include <sys/types.h>
+
+#include "queue.h"
+
+size_t journal_open(const char *fname, int resume, struct jobqueue *queue);
+int journal_is_done(size_t jobnumber);
+void journal_record(size_t jobnumber, size_t fileindex, off_t offset,
+		    int result);
+void journal_close(void);
+
+#endif
@@ -0,0 +1,289 @@
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>
+#include <assert.h>
+
+#include "jobqueue.h"
+#include "metrics.h"
+#include "support.h"
+
+/* Metrics in the Prometheus text exposition format, for the textfile
+ * collector of node_exporter. The file is rewritten every
+ * METRICS_INTERVAL_MS milliseconds and when all jobs are done. A new
+ * version is written to a temporary file that is renamed over the old one,
+ * so a scraper never sees a partial file.
+ */
+
+#define METRICS_INTERVAL_MS 5000
+
+/* Upper bounds of job duration histogram buckets in seconds */
+static const double durationbuckets[] = {0.01, 0.1, 0.5, 1, 5, 10, 30, 60,
+					 300, 900, 3600, 14400};
+#define NDURATIONBUCKETS (sizeof durationbuckets / sizeof durationbuckets[0])
+
+static const char *metricsfname;
+static char metricstmpfname[PATH_MAX];
+static uint64_t lastwrite;
+static time_t starttime;
+
+static uint64_t jobsstarted;
+static uint64_t resultcounts[JOB_RESULT_MAXIMUM];
+static uint64_t retries;
+static uint64_t *placeexecutions;
+static int nmetricsplaces;
+
+/* Cumulative counts are computed when the file is written */
+static uint64_t durationcounts[NDURATIONBUCKETS + 1];
+static double durationsum;
+
+static const char *resultnames[JOB_RESULT_MAXIMUM] = {
+	[JOB_SUCCESS] = "success",
+	[JOB_FAILURE] = "failure",
+	[JOB_BROKEN_EXECUTION_PLACE] = "broken_place",
+};
+
+
+void metrics_open(const char *fname, int nplaces)
+{
+	metricsfname = fname;
+
+	if (snprintf(metricstmpfname, sizeof metricstmpfname, "%s.tmp",
+		     fname) >= sizeof metricstmpfname)
+		die("Too long a metrics file name: %s\n", fname);
+
+	placeexecutions = calloc(nplaces, sizeof placeexecutions[0]);
+	if (placeexecutions == NULL)
+		die("No memory for metrics\n");
+
+	nmetricsplaces = nplaces;
+	starttime = time(NULL);
+	lastwrite = monotonic_ns();
+}
+
+
+/* Returns milliseconds until the next write, or -1 if there are no
+ * metrics */
+int metrics_timeout(void)
+{
+	uint64_t elapsed;
+
+	if (metricsfname == NULL)
+		return -1;
+
+	elapsed = (monotonic_ns() - lastwrite) / 1000000;
+	if (elapsed >= METRICS_INTERVAL_MS)
+		return 0;
+
+	return METRICS_INTERVAL_MS - elapsed;
+}
+
+
+void metrics_dispatch(void)
+{
+	jobsstarted++;
+}
+
+
+void metrics_job_ack(const struct job_ack *joback, int jobdone)
+{
+	double duration = 0;
+	size_t i;
+
+	if (metricsfname == NULL)
+		return;
+
+	assert(joback->result < JOB_RESULT_MAXIMUM);
+	resultcounts[joback->result]++;
+	placeexecutions[joback->place]++;
+
+	if (!jobdone)
+		retries++;
+
+	if (joback->end > joback->start)
+		duration = (joback->end - joback->start) / 1000000000.0;
+
+	for (i = 0; i < NDURATIONBUCKETS; i++) {
+		if (duration <= durationbuckets[i])
+			break;
+	}
+
+	durationcounts[i]++;
+	durationsum += duration;
+}
+
+
+/* Print a place name as a label value: \, " and newline are escaped */
+static void print_place_label(FILE *f, int place)
+{
+	struct machine *m;
+	const char *s;
+
+	if (vplist_is_empty(&machinelist)) {
+		fprintf(f, "place=\"%d\"", place + 1);
+		return;
+	}
+
+	m = vplist_get(&machinelist, place);
+	assert(m != NULL);
+
+	fprintf(f, "place=\"");
+	for (s = m->name; *s != 0; s++) {
+		if (*s == '\\' || *s == '"')
+			fputc('\\', f);
+		if (*s == '\n')
+			fputs("\\n", f);
+		else
+			fputc(*s, f);
+	}
+	fputc('"', f);
+}
+
+
+static int running_jobs(const struct executionplace *place)
+{
+	int running = 0;
+	int i;
+
+	/* jobsrunning is maxissue for a broken place, slots are exact */
+	for (i = 0; i < place->nslots; i++)
+		running += (place->slots[i] != NULL);
+
+	return running;
+}
+
+
+static void write_metrics(size_t jobsdone, const struct executionplace *places,
+			  int nplaces)
+{
+	FILE *f;
+	uint64_t cumulative = 0;
+	size_t i;
+	int p;
+
+	lastwrite = monotonic_ns();
+
+	f = fopen(metricstmpfname, "w");
+	if (f == NULL) {
+		fprintf(stderr, "Can not write metrics file %s: %s\n",
+			metricstmpfname, strerror(errno));
+		return;
+	}
+
+	fprintf(f, "# HELP jobqueue_start_time_seconds Start time of the run since the epoch.\n"
+		"# TYPE jobqueue_start_time_seconds gauge\n"
+		"jobqueue_start_time_seconds %lld\n", (long long) starttime);
+
+	fprintf(f, "# HELP jobqueue_jobs_started_total Job executions started, including retries.\n"
+		"# TYPE jobqueue_jobs_started_total counter\n"
+		"jobqueue_jobs_started_total %llu\n",
+		(unsigned long long) jobsstarted);
+
+	fprintf(f, "# HELP jobqueue_jobs_done_total Jobs that will not be executed again.\n"
+		"# TYPE jobqueue_jobs_done_total counter\n"
+		"jobqueue_jobs_done_total %zu\n", jobsdone);
+
+	fprintf(f, "# HELP jobqueue_jobs_succeeded_total Job executions that succeeded.\n"
+		"# TYPE jobqueue_jobs_succeeded_total counter\n"
+		"jobqueue_jobs_succeeded_total %llu\n",
+		(unsigned long long) resultcounts[JOB_SUCCESS]);
+
+	fprintf(f, "# HELP jobqueue_jobs_failed_total Job executions that failed, by exit class.\n"
+		"# TYPE jobqueue_jobs_failed_total counter\n");
+	for (i = JOB_FAILURE; i < JOB_RESULT_MAXIMUM; i++)
+		fprintf(f, "jobqueue_jobs_failed_total{class=\"%s\"} %llu\n",
+			resultnames[i], (unsigned long long) resultcounts[i]);
+
+	fprintf(f, "# HELP jobqueue_job_retries_total Failed job executions that were requeued.\n"
+		"# TYPE jobqueue_job_retries_total counter\n"
+		"jobqueue_job_retries_total %llu\n",
+		(unsigned long long) retries);
+
+	fprintf(f, "# HELP jobqueue_job_duration_seconds Job execution time.\n"
+		"# TYPE jobqueue_job_duration_seconds histogram\n");
+	for (i = 0; i <= NDURATIONBUCKETS; i++) {
+		cumulative += durationcounts[i];
+		if (i < NDURATIONBUCKETS)
+			fprintf(f, "jobqueue_job_duration_seconds_bucket{le=\"%g\"} %llu\n",
+				durationbuckets[i],
+				(unsigned long long) cumulative);
+		else
+			fprintf(f, "jobqueue_job_duration_seconds_bucket{le=\"+Inf\"} %llu\n",
+				(unsigned long long) cumulative);
+	}
+	fprintf(f, "jobqueue_job_duration_seconds_sum %.6f\n"
+		"jobqueue_job_duration_seconds_count %llu\n", durationsum,
+		(unsigned long long) cumulative);
+
+	fprintf(f, "# HELP jobqueue_place_executions_total Job executions finished on an execution place.\n"
+		"# TYPE jobqueue_place_executions_total counter\n");
+	for (p = 0; p < nplaces; p++) {
+		fprintf(f, "jobqueue_place_executions_total{");
+		print_place_label(f, p);
+		fprintf(f, "} %llu\n", (unsigned long long) placeexecutions[p]);
+	}
+
+	fprintf(f, "# HELP jobqueue_place_running_jobs Jobs running on an execution place.\n"
+		"# TYPE jobqueue_place_running_jobs gauge\n");
+	for (p = 0; p < nplaces; p++) {
+		fprintf(f, "jobqueue_place_running_jobs{");
+		print_place_label(f, p);
+		fprintf(f, "} %d\n", running_jobs(&places[p]));
+	}
+
+	fprintf(f, "# HELP jobqueue_place_max_jobs Maximum number of jobs on an execution place.\n"
+		"# TYPE jobqueue_place_max_jobs gauge\n");
+	for (p = 0; p < nplaces; p++) {
+		fprintf(f, "jobqueue_place_max_jobs{");
+		print_place_label(f, p);
+		fprintf(f, "} %d\n", places[p].maxissue);
+	}
+
+	fprintf(f, "# HELP jobqueue_place_broken 1 if an execution place is broken.\n"
+		"# TYPE jobqueue_place_broken gauge\n");
+	for (p = 0; p < nplaces; p++) {
+		fprintf(f, "jobqueue_place_broken{");
+		print_place_label(f, p);
+		fprintf(f, "} %d\n", places[p].broken ? 1 : 0);
+	}
+
+	if (fclose(f)) {
+		fprintf(stderr, "Can not write metrics file %s: %s\n",
+			metricstmpfname, strerror(errno));
+		return;
+	}
+
+	if (rename(metricstmpfname, metricsfname))
+		fprintf(stderr, "Can not rename %s to %s: %s\n",
+			metricstmpfname, metricsfname, strerror(errno));
+}
+
+
+void metrics_update(size_t jobsdone, const struct executionplace *places,
+		    int nplaces)
+{
+	if (metrics_timeout() != 0)
+		return;
+
+	assert(nplaces == nmetricsplaces);
+
+	write_metrics(jobsdone, places, nplaces);
+}
+
+
+void metrics_close(size_t jobsdone, const struct executionplace *places,
+		   int nplaces)
+{
+	if (metricsfname == NULL)
+		return;
+
+	write_metrics(jobsdone, places, nplaces);
+
+	metricsfname = NULL;
+}
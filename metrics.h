@@ -0,0 +1,17 @@
+#ifndef _JOBQUEUE_METRICS_H_
+#define _JOBQUEUE_METRICS_H_
+
+#include <stddef.h>
+
+#include "schedule.h"
+
+void metrics_open(const char *fname, int nplaces);
+int metrics_timeout(void);
+void metrics_dispatch(void);
+void metrics_job_ack(const struct job_ack *joback, int jobdone);
+void metrics_update(size_t jobsdone, const struct executionplace *places,
+		    int nplaces);
+void metrics_close(size_t jobsdone, const struct executionplace *places,
+		   int nplaces);
+
+#endif
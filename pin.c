@@ -0,0 +1,260 @@
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <dirent.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+#include "jobqueue.h"
+#include "pin.h"
+#include "support.h"
+
+/* CPU pinning of local jobs (--pin). The CPUs that jobqueue may run on
+ * are divided into units: cores (hardware threads of one core together)
+ * or NUMA nodes, as described by sysfs. Slots of all execution places are
+ * numbered in order, and a job in slot i is pinned to unit i modulo the
+ * number of units with sched_setaffinity(). Optionally, the memory of the
+ * job is bound to, or preferred from, the NUMA node of the unit.
+ *
+ * Pinning is done in the runner process. The job shell that the runner
+ * forks inherits the affinity and the memory policy.
+ */
+
+#define SYSFS_CPU "/sys/devices/system/cpu"
+#define SYSFS_NODE "/sys/devices/system/node"
+
+#define PIN_MAX_NODES 1024
+
+struct pinunit {
+	cpu_set_t cpus;
+	int node;  /* -1 if not known */
+};
+
+static struct pinunit *units;
+static int nunits;
+static int mempolicy = MPOL_DEFAULT;
+
+/* Number of the first slot of each place */
+static int *slotbase;
+
+
+/* Parse a sysfs CPU list such as "0-3,8-11" */
+static int parse_cpulist(cpu_set_t *set, const char *list)
+{
+	const char *s = list;
+	char *end;
+	long first, last, cpu;
+
+	CPU_ZERO(set);
+
+	while (*s != 0 && *s != '\n') {
+		first = strtol(s, &end, 10);
+		if (end == s || first < 0)
+			return -1;
+
+		last = first;
+		if (*end == '-') {
+			s = end + 1;
+			last = strtol(s, &end, 10);
+			if (end == s || last < first)
+				return -1;
+		}
+
+		for (cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++)
+			CPU_SET(cpu, set);
+
+		s = end;
+		if (*s == ',')
+			s++;
+	}
+
+	return 0;
+}
+
+
+static int read_cpulist(cpu_set_t *set, const char *fname)
+{
+	FILE *f;
+	char buf[4096];
+	int ret = -1;
+
+	f = fopen(fname, "r");
+	if (f == NULL)
+		return -1;
+
+	if (fgets(buf, sizeof buf, f) != NULL)
+		ret = parse_cpulist(set, buf);
+
+	fclose(f);
+
+	return ret;
+}
+
+
+static void add_unit(const cpu_set_t *cpus, int node)
+{
+	struct pinunit *newunits;
+
+	newunits = realloc(units, (nunits + 1) * sizeof units[0]);
+	if (newunits == NULL)
+		die("No memory for CPU pinning\n");
+
+	units = newunits;
+	units[nunits].cpus = *cpus;
+	units[nunits].node = node;
+	nunits++;
+}
+
+
+/* Returns the NUMA node of cpu, or -1 */
+static int cpu_node(int cpu)
+{
+	char fname[256];
+	cpu_set_t set;
+	int node;
+
+	for (node = 0; node < PIN_MAX_NODES; node++) {
+		snprintf(fname, sizeof fname, SYSFS_NODE "/node%d/cpulist", node);
+		if (read_cpulist(&set, fname))
+			continue;
+
+		if (CPU_ISSET(cpu, &set))
+			return node;
+	}
+
+	return -1;
+}
+
+
+static void find_cores(const cpu_set_t *allowed)
+{
+	char fname[256];
+	cpu_set_t siblings, core, used;
+	int cpu;
+
+	CPU_ZERO(&used);
+
+	for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		if (!CPU_ISSET(cpu, allowed) || CPU_ISSET(cpu, &used))
+			continue;
+
+		snprintf(fname, sizeof fname,
+			 SYSFS_CPU "/cpu%d/topology/thread_siblings_list", cpu);
+		if (read_cpulist(&siblings, fname)) {
+			CPU_ZERO(&siblings);
+			CPU_SET(cpu, &siblings);
+		}
+
+		CPU_AND(&core, &siblings, allowed);
+		CPU_OR(&used, &used, &core);
+
+		add_unit(&core, cpu_node(cpu));
+	}
+}
+
+
+static void find_nodes(const cpu_set_t *allowed)
+{
+	char fname[256];
+	cpu_set_t nodecpus, cpus;
+	int node;
+
+	for (node = 0; node < PIN_MAX_NODES; node++) {
+		snprintf(fname, sizeof fname, SYSFS_NODE "/node%d/cpulist", node);
+		if (read_cpulist(&nodecpus, fname))
+			continue;
+
+		CPU_AND(&cpus, &nodecpus, allowed);
+		if (CPU_COUNT(&cpus) > 0)
+			add_unit(&cpus, node);
+	}
+
+	/* A kernel without NUMA support has no node directories */
+	if (nunits == 0)
+		add_unit(allowed, -1);
+}
+
+
+/* spec is "core" or "numa", optionally followed by ",mem=bind" or
+ * ",mem=preferred" */
+void pin_init(const char *spec, const struct executionplace *places,
+	      int nplaces)
+{
+	cpu_set_t allowed;
+	char *copy;
+	char *item, *value, *saveptr;
+	int i;
+
+	copy = strdup(spec);
+	if (copy == NULL)
+		die("No memory for CPU pinning\n");
+
+	if (sched_getaffinity(0, sizeof allowed, &allowed))
+		dieerror("Can not get CPU affinity");
+
+	item = strtok_r(copy, ",", &saveptr);
+	if (item != NULL && strcmp(item, "core") == 0)
+		find_cores(&allowed);
+	else if (item != NULL && strcmp(item, "numa") == 0)
+		find_nodes(&allowed);
+	else
+		die("Unknown pinning mode: %s\n", spec);
+
+	while ((item = strtok_r(NULL, ",", &saveptr)) != NULL) {
+		value = strchr(item, '=');
+		if (value == NULL || strncmp(item, "mem=", 4) != 0)
+			die("Unknown pinning parameter: %s\n", item);
+		value++;
+
+		if (strcmp(value, "bind") == 0)
+			mempolicy = MPOL_BIND;
+		else if (strcmp(value, "preferred") == 0)
+			mempolicy = MPOL_PREFERRED;
+		else
+			die("Unknown memory policy: %s\n", value);
+	}
+
+	free(copy);
+
+	slotbase = malloc(nplaces * sizeof slotbase[0]);
+	if (slotbase == NULL)
+		die("No memory for CPU pinning\n");
+
+	for (i = 0; i < nplaces; i++)
+		slotbase[i] = (i > 0) ? slotbase[i - 1] + places[i - 1].nslots : 0;
+
+	if (VERBOSE)
+		fprintf(stderr, "Pinning jobs to %d %s\n", nunits,
+			(strncmp(spec, "core", 4) == 0) ? "cores" : "NUMA nodes");
+}
+
+
+/* Called in the runner process before the job is executed */
+void pin_job(int place, int slot)
+{
+	struct pinunit *unit;
+	unsigned long nodemask[PIN_MAX_NODES / (8 * sizeof(unsigned long))];
+
+	if (units == NULL)
+		return;
+
+	unit = &units[(slotbase[place] + slot) % nunits];
+
+	if (sched_setaffinity(0, sizeof unit->cpus, &unit->cpus))
+		fprintf(stderr, "Can not pin job to CPUs: %s\n", strerror(errno));
+
+	if (mempolicy == MPOL_DEFAULT || unit->node < 0)
+		return;
+
+	memset(nodemask, 0, sizeof nodemask);
+	nodemask[unit->node / (8 * sizeof(unsigned long))] |=
+		1UL << (unit->node % (8 * sizeof(unsigned long)));
+
+	if (syscall(SYS_set_mempolicy, mempolicy, nodemask, PIN_MAX_NODES + 1))
+		fprintf(stderr, "Can not set memory policy: %s\n",
+			strerror(errno));
+}
@@ -0,0 +1,10 @@
+#ifndef _JOBQUEUE_PIN_H_
+#define _JOBQUEUE_PIN_H_
+
+#include "schedule.h"
+
+void pin_init(const char *spec, const struct executionplace *places,
+	      int nplaces);
+void pin_job(int place, int slot);
+
+#endif
@@ -0,0 +1,256 @@
+#define _GNU_SOURCE
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+#include <assert.h>
+#include <sys/ioctl.h>
+
+#include "jobqueue.h"
+#include "eta.h"
+#include "progress.h"
+#include "support.h"
+
+/* A single status line on a terminal. The line is redrawn at most every
+ * PROGRESS_INTERVAL_MS milliseconds, and only from the scheduler loop, so
+ * the cost does not depend on the job rate. */
+
+#define PROGRESS_INTERVAL_MS 200
+#define PROGRESS_LINE_SIZE 1024
+
+/* Weight of the newest interval in the job rate */
+#define PROGRESS_RATE_ALPHA 0.3
+
+static int enabled;
+static int nprogressplaces;
+static int *placerunning;
+static uint64_t lastdraw;
+static size_t lastdone;
+static double rate;
+
+static size_t running;
+static size_t failed;
+static size_t requeued;
+
+static char line[PROGRESS_LINE_SIZE];
+static size_t linelen;
+
+
+void progress_init(int nplaces, size_t jobsdone)
+{
+	if (!showprogress || !isatty(2))
+		return;
+
+	placerunning = calloc(nplaces, sizeof placerunning[0]);
+	if (placerunning == NULL)
+		die("No memory for progress meter\n");
+
+	nprogressplaces = nplaces;
+	lastdraw = monotonic_ns();
+	lastdone = jobsdone;
+	enabled = 1;
+}
+
+
+int progress_enabled(void)
+{
+	return enabled;
+}
+
+
+/* Returns milliseconds until the next redraw, or -1 if there is no
+ * progress meter */
+int progress_timeout(void)
+{
+	uint64_t elapsed;
+
+	if (!enabled)
+		return -1;
+
+	elapsed = (monotonic_ns() - lastdraw) / 1000000;
+	if (elapsed >= PROGRESS_INTERVAL_MS)
+		return 0;
+
+	return PROGRESS_INTERVAL_MS - elapsed;
+}
+
+
+void progress_dispatch(int place)
+{
+	if (!enabled)
+		return;
+
+	running++;
+	placerunning[place]++;
+}
+
+
+void progress_job_ack(const struct job_ack *joback, int jobdone)
+{
+	if (!enabled)
+		return;
+
+	assert(running > 0 && placerunning[joback->place] > 0);
+	running--;
+	placerunning[joback->place]--;
+
+	if (!jobdone)
+		requeued++;
+	else if (joback->result != JOB_SUCCESS)
+		failed++;
+}
+
+
+/* A job execution ended without a result (a speculative copy lost) */
+void progress_job_cancel(int place)
+{
+	if (!enabled)
+		return;
+
+	assert(running > 0 && placerunning[place] > 0);
+	running--;
+	placerunning[place]--;
+}
+
+
+static void line_printf(const char *fmt, ...) __attribute__ ((format (printf, 1, 2)));
+
+static void line_printf(const char *fmt, ...)
+{
+	va_list ap;
+	int ret;
+
+	if (linelen >= sizeof line)
+		return;
+
+	va_start(ap, fmt);
+	ret = vsnprintf(line + linelen, sizeof line - linelen, fmt, ap);
+	va_end(ap);
+
+	if (ret > 0)
+		linelen += ret;
+	if (linelen >= sizeof line)
+		linelen = sizeof line - 1;
+}
+
+
+static void line_time(double s)
+{
+	long t = s + 0.5;
+
+	if (t >= 3600)
+		line_printf("%ldh%02ldm%02lds", t / 3600, (t / 60) % 60, t % 60);
+	else if (t >= 60)
+		line_printf("%ldm%02lds", t / 60, t % 60);
+	else
+		line_printf("%lds", t);
+}
+
+
+static size_t terminal_width(void)
+{
+	struct winsize ws;
+
+	if (ioctl(2, TIOCGWINSZ, &ws) || ws.ws_col == 0)
+		return 80;
+
+	return ws.ws_col;
+}
+
+
+static void draw(size_t jobsdone, size_t njobs,
+		 const struct executionplace *places, int nplaces)
+{
+	struct etaestimate est;
+	size_t width = terminal_width();
+	size_t written = 0;
+	ssize_t ret;
+	int i;
+
+	linelen = 0;
+
+	line_printf("\r");
+
+	if (njobs > 0)
+		line_printf("[%zu/%zu] ", jobsdone, njobs);
+
+	line_printf("done %zu, running %zu, failed %zu, requeued %zu, %.1f jobs/s",
+		    jobsdone, running, failed, requeued, rate);
+
+	if (njobs > jobsdone &&
+	    eta_estimate(&est, jobsdone, njobs, places, nplaces) == 0) {
+		line_printf(", ETA ");
+		line_time(est.eta);
+		line_printf(" (");
+		line_time(est.low);
+		line_printf("-");
+		line_time(est.high);
+		line_printf(")");
+	}
+
+	line_printf(", places");
+	for (i = 0; i < nplaces; i++) {
+		if (places[i].broken)
+			line_printf(" X");
+		else
+			line_printf(" %d/%d", placerunning[i],
+				    places[i].maxissue);
+	}
+
+	/* The line must not wrap, or \r can not return to its start */
+	if (linelen > width)
+		linelen = width;
+
+	line_printf("\033[K");
+
+	while (written < linelen) {
+		ret = write(2, line + written, linelen - written);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		written += ret;
+	}
+}
+
+
+void progress_update(size_t jobsdone, size_t njobs,
+		     const struct executionplace *places, int nplaces)
+{
+	uint64_t now;
+	double dt;
+
+	if (progress_timeout() != 0)
+		return;
+
+	assert(nplaces == nprogressplaces);
+
+	now = monotonic_ns();
+	dt = (now - lastdraw) / 1000000000.0;
+
+	rate += PROGRESS_RATE_ALPHA * ((jobsdone - lastdone) / dt - rate);
+
+	lastdraw = now;
+	lastdone = jobsdone;
+
+	draw(jobsdone, njobs, places, nplaces);
+}
+
+
+void progress_close(size_t jobsdone, size_t njobs,
+		    const struct executionplace *places, int nplaces)
+{
+	if (!enabled)
+		return;
+
+	/* Leave the final state visible */
+	draw(jobsdone, njobs, places, nplaces);
+	fprintf(stderr, "\n");
+
+	enabled = 0;
+}
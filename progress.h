@@ -0,0 +1,19 @@
+#ifndef _JOBQUEUE_PROGRESS_H_
+#define _JOBQUEUE_PROGRESS_H_
+
+#include <stddef.h>
+
+#include "schedule.h"
+
+void progress_init(int nplaces, size_t jobsdone);
+int progress_enabled(void);
+int progress_timeout(void);
+void progress_dispatch(int place);
+void progress_job_ack(const struct job_ack *joback, int jobdone);
+void progress_job_cancel(int place);
+void progress_update(size_t jobsdone, size_t njobs,
+		     const struct executionplace *places, int nplaces);
+void progress_close(size_t jobsdone, size_t njobs,
+		    const struct executionplace *places, int nplaces);
+
+#endif
@@ -12,11 +12,15 @@
 
 static struct vplist jobfilenames = VPLIST_INITIALIZER;
 
+/* Number of file names popped from jobfilenames */
+static size_t njobfilespopped;
+
 
 /* We try to fopen() each file in the jobfiles list, and return the first
- * successfully opened file. Otherwise return NULL.
+ * successfully opened file. Otherwise return NULL. The index of the
+ * opened file is stored into queue->fileindex.
  */
-static FILE *cq_get_next_jobfile(void)
+static FILE *cq_get_next_jobfile(struct jobqueue *queue)
 {
 	char *fname;
 	FILE *f = NULL;
@@ -27,6 +31,10 @@ static FILE *cq_get_next_jobfile(void)
 		if (fname == NULL)
 			break;
 
+		queue->fileindex = njobfilespopped;
+		queue->offset = 0;
+		njobfilespopped++;
+
 		f = fopen(fname, "r");
 
 		if (f)
@@ -48,14 +56,15 @@ static int cq_next(char *cmd, size_t maxlen, struct jobqueue *queue)
 
 	while (1) {
 		if (jobfile == NULL) {
-			jobfile = cq_get_next_jobfile();
+			jobfile = cq_get_next_jobfile(queue);
 
 			if (jobfile == NULL)
 				break;
 		}
 
 		/* Read a new job and strip the line */
-		ret = read_stripped_line(cmd, maxlen, jobfile);
+		ret = read_stripped_line_offset(cmd, maxlen, jobfile,
+						&queue->offset);
 		if (ret < 0) {
 			fclose(jobfile);
 			jobfile = NULL;
@@ -72,6 +81,44 @@ static int cq_next(char *cmd, size_t maxlen, struct jobqueue *queue)
 }
 
 
+static int cq_seek(struct jobqueue *queue, size_t fileindex, off_t offset)
+{
+	FILE *jobfile = (FILE *) queue->data;
+	char line[MAX_CMD_SIZE];
+
+	/* Seeking is only possible before the first job has been read */
+	if (jobfile != NULL || njobfilespopped > fileindex)
+		return -1;
+
+	while (njobfilespopped < fileindex) {
+		free(vplist_pop_head(&jobfilenames));
+		njobfilespopped++;
+	}
+
+	jobfile = cq_get_next_jobfile(queue);
+	if (jobfile == NULL || queue->fileindex != fileindex)
+		die("Can not resume from job file number %zd\n", fileindex + 1);
+
+	if (fseeko(jobfile, offset, SEEK_SET) == 0) {
+		queue->offset = offset;
+	} else {
+		/* Not seekable (a pipe), skip lines */
+		while (queue->offset < offset) {
+			if (read_stripped_line_offset(line, sizeof line, jobfile,
+						      &queue->offset) < 0)
+				break;
+		}
+	}
+
+	if (queue->offset != offset)
+		die("Can not resume from job file number %zd: file is too short\n",
+		    fileindex + 1);
+
+	queue->data = jobfile;
+
+	return 0;
+}
+
 static int tg_next(char *cmd, size_t maxlen, struct jobqueue *queue)
 {
 	return 0;
@@ -88,6 +135,7 @@ struct jobqueue *init_queue(char *argv[], int i, int argc, int taskgraphmode)
 		die("Not enough memory for struct jobqueue\n");
 
 	queue->next = taskgraphmode ? tg_next : cq_next;
+	queue->seek = taskgraphmode ? NULL : cq_seek;
 
 	use_stdin = (i == argc);
 
@@ -2,6 +2,7 @@
 #define _JOBQUEUE_QUEUE_H_
 
 #include <stdio.h>
+#include <sys/types.h>
 
 #define MAX_CMD_SIZE 65536
 
@@ -10,6 +11,17 @@ struct jobqueue;
 struct jobqueue {
 	int (*next)(char *cmd, size_t maxlen, struct jobqueue *queue);
 
+	/* Continue reading jobs from a position that was earlier reported by
+	 * next() through fileindex and offset. Returns 0 on success, -1 if
+	 * the queue can not seek. */
+	int (*seek)(struct jobqueue *queue, size_t fileindex, off_t offset);
+
+	/* Position right after the job returned by the last next() call:
+	 * the index of the job file (in command line order) and a byte
+	 * offset in that file. */
+	size_t fileindex;
+	off_t offset;
+
 	void *data;
 };
 
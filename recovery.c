@@ -0,0 +1,206 @@
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "jobqueue.h"
+#include "recovery.h"
+#include "support.h"
+
+/* Recovery of broken execution places (--recover and --probe). A broken
+ * place is probed after a backoff: the scheduler runs the probe command on
+ * it, or lets one job of the queue (a canary) start on it. If the probe
+ * shows that the place works, the place is restored (see end_probe() in
+ * schedule.c). Otherwise the backoff is doubled, up to a maximum, and the
+ * place is probed again later. A place that breaks again after it has been
+ * restored also gets a doubled backoff, so a flapping place is probed less
+ * and less often.
+ *
+ * A place is only probed when it has a free slot. Jobs that were running
+ * on the place when it broke keep their slots until they finish.
+ */
+
+#define RECOVERY_BACKOFF 30.0
+#define RECOVERY_MAX_BACKOFF 900.0
+
+struct recoveryplace {
+	uint64_t backoff;    /* ns */
+	uint64_t probetime;  /* monotonic_ns() time of the next probe */
+	int waiting;         /* Broken, and the probe has not started */
+	int restored;        /* Has been restored at least once */
+};
+
+static struct recoveryplace *rplaces;
+static int nwaiting;
+static uint64_t initialbackoff;
+static uint64_t maxbackoff;
+
+
+static uint64_t parse_seconds(const char *name, const char *value)
+{
+	char *endptr;
+	double seconds = strtod(value, &endptr);
+
+	if (*endptr != 0 || !(seconds > 0))
+		die("Invalid %s for --recover: %s\n", name, value);
+
+	return seconds * 1000000000.0;
+}
+
+
+/* spec is a comma separated list of backoff=SECONDS and max=SECONDS, or
+ * NULL for defaults */
+void recovery_init(const char *spec, int nplaces)
+{
+	char *copy = NULL;
+	char *item, *value, *saveptr;
+
+	initialbackoff = RECOVERY_BACKOFF * 1000000000.0;
+	maxbackoff = RECOVERY_MAX_BACKOFF * 1000000000.0;
+
+	if (spec != NULL) {
+		copy = strdup(spec);
+		if (copy == NULL)
+			die("No memory for place recovery\n");
+	}
+
+	for (item = (copy != NULL) ? strtok_r(copy, ",", &saveptr) : NULL;
+	     item != NULL; item = strtok_r(NULL, ",", &saveptr)) {
+		value = strchr(item, '=');
+		if (value == NULL)
+			die("Invalid recovery parameter: %s\n", item);
+		*value++ = 0;
+
+		if (strcmp(item, "backoff") == 0)
+			initialbackoff = parse_seconds("backoff", value);
+		else if (strcmp(item, "max") == 0)
+			maxbackoff = parse_seconds("max", value);
+		else
+			die("Unknown recovery parameter: %s\n", item);
+	}
+
+	free(copy);
+
+	if (maxbackoff < initialbackoff)
+		maxbackoff = initialbackoff;
+
+	rplaces = calloc(nplaces, sizeof rplaces[0]);
+	if (rplaces == NULL)
+		die("No memory for place recovery\n");
+}
+
+
+static double schedule_probe(struct recoveryplace *rp, int doublebackoff)
+{
+	if (rp->backoff == 0) {
+		rp->backoff = initialbackoff;
+	} else if (doublebackoff) {
+		rp->backoff *= 2;
+		if (rp->backoff > maxbackoff)
+			rp->backoff = maxbackoff;
+	}
+
+	rp->probetime = monotonic_ns() + rp->backoff;
+	rp->waiting = 1;
+	nwaiting++;
+
+	return rp->backoff / 1000000000.0;
+}
+
+
+/* Schedule the first probe of a place that broke. Returns the delay in
+ * seconds. */
+double recovery_place_broken(int place)
+{
+	struct recoveryplace *rp = &rplaces[place];
+
+	return schedule_probe(rp, rp->restored);
+}
+
+
+/* Schedule the next probe of a place whose probe failed. Returns the delay
+ * in seconds. */
+double recovery_probe_failed(int place)
+{
+	return schedule_probe(&rplaces[place], 1);
+}
+
+
+void recovery_place_restored(int place)
+{
+	rplaces[place].restored = 1;
+}
+
+
+static int has_free_slot(const struct executionplace *place)
+{
+	int slot;
+
+	for (slot = 0; slot < place->nslots; slot++) {
+		if (place->slots[slot] == NULL)
+			return 1;
+	}
+
+	return 0;
+}
+
+
+/* Returns a broken place that is due for a probe and has a free slot, or
+ * -1. The caller must start the probe. */
+int recovery_due(const struct executionplace *places, int nplaces)
+{
+	uint64_t now;
+	int i;
+
+	if (nwaiting == 0)
+		return -1;
+
+	now = monotonic_ns();
+
+	for (i = 0; i < nplaces; i++) {
+		if (!rplaces[i].waiting || now < rplaces[i].probetime ||
+		    !has_free_slot(&places[i]))
+			continue;
+
+		rplaces[i].waiting = 0;
+		nwaiting--;
+		return i;
+	}
+
+	return -1;
+}
+
+
+/* Returns milliseconds until the next probe, or -1 if no probe is
+ * waiting. A place without a free slot gets one when a job finishes,
+ * which ends the wait anyway. */
+int recovery_timeout(const struct executionplace *places, int nplaces)
+{
+	uint64_t now;
+	uint64_t next = UINT64_MAX;
+	int i;
+
+	if (nwaiting == 0)
+		return -1;
+
+	now = monotonic_ns();
+
+	for (i = 0; i < nplaces; i++) {
+		if (!rplaces[i].waiting || !has_free_slot(&places[i]))
+			continue;
+
+		if (rplaces[i].probetime <= now)
+			return 0;
+
+		if (rplaces[i].probetime - now < next)
+			next = rplaces[i].probetime - now;
+	}
+
+	if (next == UINT64_MAX)
+		return -1;
+
+	/* Round up, so that the probe is due when the wait ends */
+	return (next + 999999) / 1000000;
+}
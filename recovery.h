@@ -0,0 +1,13 @@
+#ifndef _JOBQUEUE_RECOVERY_H_
+#define _JOBQUEUE_RECOVERY_H_
+
+#include "schedule.h"
+
+void recovery_init(const char *spec, int nplaces);
+double recovery_place_broken(int place);
+double recovery_probe_failed(int place);
+void recovery_place_restored(int place);
+int recovery_due(const struct executionplace *places, int nplaces);
+int recovery_timeout(const struct executionplace *places, int nplaces);
+
+#endif
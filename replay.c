@@ -0,0 +1,364 @@
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+#include "jobqueue.h"
+#include "replay.h"
+#include "support.h"
+
+/* Capacity planning from a results file (see --results). Each job
+ * execution that was recorded occupied a slot from dispatch to end. The
+ * plain queue scheduler is simulated in virtual time with the same
+ * executions on a given number of slots: a free slot takes a requeued
+ * job if there is one, and otherwise the next new job in the chosen
+ * order. A requeued execution becomes ready when the previous execution
+ * of the same job ends, as in schedule().
+ *
+ * All slots are assumed to be equally fast, and places are never
+ * broken, so the prediction is only as good as the recorded durations
+ * are for the simulated machines.
+ */
+
+enum replay_order {
+	REPLAY_FIFO = 0,
+	REPLAY_LONGEST,
+	REPLAY_SHORTEST,
+	REPLAY_NORDERS,
+};
+
+static const char *ordernames[REPLAY_NORDERS] = {"fifo", "longest", "shortest"};
+
+struct replayjob {
+	double total;     /* Sum of durations of all executions */
+	double *durations;
+	int n;
+	int allocated;
+};
+
+struct running {
+	double end;
+	size_t seq;       /* Ties are broken in dispatch order */
+	struct replayjob *job;
+	int execution;
+};
+
+struct replay {
+	struct replayjob *jobs;
+	size_t njobs;     /* Highest job number + 1 */
+	size_t nexecutions;
+	double busy;
+	double firstdispatch;
+	double lastend;
+};
+
+
+static void add_execution(struct replay *r, size_t jobnumber,
+			  double dispatch, double end)
+{
+	struct replayjob *job;
+	struct replayjob *newjobs;
+	double *newdurations;
+	size_t newn;
+	double duration = (end > dispatch) ? (end - dispatch) : 0.0;
+
+	if (jobnumber >= r->njobs) {
+		newn = r->njobs ? r->njobs : 1024;
+		while (newn <= jobnumber)
+			newn *= 2;
+
+		newjobs = realloc(r->jobs, newn * sizeof newjobs[0]);
+		if (newjobs == NULL)
+			die("No memory for replay\n");
+
+		memset(newjobs + r->njobs, 0,
+		       (newn - r->njobs) * sizeof newjobs[0]);
+		r->jobs = newjobs;
+		r->njobs = newn;
+	}
+
+	job = &r->jobs[jobnumber];
+
+	if (job->n == job->allocated) {
+		job->allocated = job->allocated ? 2 * job->allocated : 1;
+		newdurations = realloc(job->durations,
+				       job->allocated * sizeof newdurations[0]);
+		if (newdurations == NULL)
+			die("No memory for replay\n");
+		job->durations = newdurations;
+	}
+
+	job->durations[job->n++] = duration;
+	job->total += duration;
+
+	if (r->nexecutions == 0 || dispatch < r->firstdispatch)
+		r->firstdispatch = dispatch;
+	if (end > r->lastend)
+		r->lastend = end;
+
+	r->busy += duration;
+	r->nexecutions++;
+}
+
+
+static int read_results(struct replay *r, const char *fname)
+{
+	FILE *f;
+	char *line = NULL;
+	size_t linesize = 0;
+	size_t lineno = 0;
+	size_t jobnumber;
+	int place, result, retries;
+	double dispatch, start, end;
+
+	f = fopen(fname, "r");
+	if (f == NULL) {
+		fprintf(stderr, "Can not open %s: %s\n", fname, strerror(errno));
+		return 1;
+	}
+
+	while (getline(&line, &linesize, f) >= 0) {
+		lineno++;
+
+		if (lineno == 1 && strncmp(line, "jobnumber,", 10) == 0)
+			continue;
+
+		if (sscanf(line, "%zu,%d,%d,%d,%lf,%lf,%lf,", &jobnumber,
+			   &place, &result, &retries, &dispatch, &start,
+			   &end) != 7) {
+			fprintf(stderr, "%s:%zu: Invalid results line\n", fname,
+				lineno);
+			free(line);
+			fclose(f);
+			return 1;
+		}
+
+		add_execution(r, jobnumber, dispatch, end);
+	}
+
+	free(line);
+	fclose(f);
+
+	return 0;
+}
+
+
+static int running_before(const struct running *a, const struct running *b)
+{
+	if (a->end != b->end)
+		return a->end < b->end;
+
+	return a->seq < b->seq;
+}
+
+
+static void heap_push(struct running *heap, size_t *n, struct running x)
+{
+	size_t i = (*n)++;
+
+	while (i > 0 && running_before(&x, &heap[(i - 1) / 2])) {
+		heap[i] = heap[(i - 1) / 2];
+		i = (i - 1) / 2;
+	}
+	heap[i] = x;
+}
+
+
+static struct running heap_pop(struct running *heap, size_t *n)
+{
+	struct running top = heap[0];
+	struct running last = heap[--(*n)];
+	size_t i = 0, child;
+
+	while ((child = 2 * i + 1) < *n) {
+		if (child + 1 < *n && running_before(&heap[child + 1], &heap[child]))
+			child++;
+
+		if (!running_before(&heap[child], &last))
+			break;
+
+		heap[i] = heap[child];
+		i = child;
+	}
+	if (*n > 0)
+		heap[i] = last;
+
+	return top;
+}
+
+
+static enum replay_order sortorder;
+
+static int compare_jobs(const void *a, const void *b)
+{
+	const struct replayjob *ja = *(struct replayjob * const *) a;
+	const struct replayjob *jb = *(struct replayjob * const *) b;
+
+	if (ja->total == jb->total)
+		return (ja < jb) ? -1 : (ja > jb);
+
+	if (sortorder == REPLAY_LONGEST)
+		return (ja->total > jb->total) ? -1 : 1;
+
+	return (ja->total < jb->total) ? -1 : 1;
+}
+
+
+/* Simulate the queue on nslots slots. Returns the makespan in seconds. */
+static double simulate(const struct replay *r, struct replayjob **order,
+		       size_t norder, long nslots)
+{
+	struct running *heap;
+	struct running *retries;
+	struct running cur;
+	size_t nrunning = 0;
+	size_t retryhead = 0, retrytail = 0;
+	size_t next = 0;
+	size_t seq = 0;
+	long freeslots = nslots;
+	double now = 0.0;
+
+	heap = malloc((r->nexecutions + 1) * sizeof heap[0]);
+	retries = malloc((r->nexecutions + 1) * sizeof retries[0]);
+	if (heap == NULL || retries == NULL)
+		die("No memory for replay\n");
+
+	while (1) {
+		/* Requeued jobs are issued before new jobs */
+		while (freeslots > 0) {
+			if (retryhead < retrytail) {
+				cur = retries[retryhead++];
+			} else if (next < norder) {
+				cur = (struct running) {.job = order[next++]};
+			} else {
+				break;
+			}
+
+			cur.end = now + cur.job->durations[cur.execution];
+			cur.seq = seq++;
+			heap_push(heap, &nrunning, cur);
+			freeslots--;
+		}
+
+		if (nrunning == 0)
+			break;
+
+		cur = heap_pop(heap, &nrunning);
+		now = cur.end;
+		freeslots++;
+
+		if (cur.execution + 1 < cur.job->n) {
+			cur.execution++;
+			retries[retrytail++] = cur;
+		}
+	}
+
+	free(heap);
+	free(retries);
+
+	return now;
+}
+
+
+/* Count slots in the same way as setup_execution_places() in schedule.c */
+static long count_slots(int nplaces, int maxissue)
+{
+	struct machine *m;
+	long nslots = 0;
+	int i;
+
+	if (maxissue != -1)
+		return (long) nplaces * maxissue;
+
+	if (vplist_is_empty(&machinelist))
+		return nplaces;
+
+	for (i = 0; i < nplaces; i++) {
+		m = vplist_get(&machinelist, i);
+		assert(m != NULL);
+		nslots += m->maxissue;
+	}
+
+	return nslots;
+}
+
+
+int replay(const char *fname, int nplaces, int maxissue)
+{
+	struct replay r = {.jobs = NULL};
+	struct replayjob **fifo;
+	struct replayjob **order;
+	size_t norder = 0;
+	size_t i;
+	long nslots = count_slots(nplaces, maxissue);
+	double recorded;
+	double longest = 0.0;
+	double bound;
+	double makespan;
+	int o;
+
+	if (read_results(&r, fname))
+		return 1;
+
+	if (r.nexecutions == 0) {
+		fprintf(stderr, "%s has no job executions\n", fname);
+		return 1;
+	}
+
+	fifo = malloc(r.njobs * sizeof fifo[0]);
+	order = malloc(r.njobs * sizeof order[0]);
+	if (fifo == NULL || order == NULL)
+		die("No memory for replay\n");
+
+	/* Job numbers are in job file order */
+	for (i = 0; i < r.njobs; i++) {
+		if (r.jobs[i].n == 0)
+			continue;
+
+		fifo[norder++] = &r.jobs[i];
+		if (r.jobs[i].total > longest)
+			longest = r.jobs[i].total;
+	}
+
+	recorded = r.lastend - r.firstdispatch;
+
+	/* Executions of one job can not overlap */
+	bound = r.busy / nslots;
+	if (longest > bound)
+		bound = longest;
+
+	printf("Replay of %zu jobs (%zu executions) from %s\n", norder,
+	       r.nexecutions, fname);
+	printf("  Recorded makespan %.3fs, slot time %.3fs\n", recorded, r.busy);
+	printf("  Simulated slots %ld, makespan lower bound %.3fs\n", nslots,
+	       bound);
+	printf("  %-10s %12s %12s %8s\n", "order", "makespan s", "utilization",
+	       "speedup");
+
+	for (o = 0; o < REPLAY_NORDERS; o++) {
+		memcpy(order, fifo, norder * sizeof order[0]);
+
+		if (o != REPLAY_FIFO) {
+			sortorder = o;
+			qsort(order, norder, sizeof order[0], compare_jobs);
+		}
+
+		makespan = simulate(&r, order, norder, nslots);
+
+		printf("  %-10s %12.3f %10.1f %% %8.2f\n", ordernames[o],
+		       makespan,
+		       makespan > 0 ? 100.0 * r.busy / (makespan * nslots) : 0.0,
+		       makespan > 0 ? recorded / makespan : 0.0);
+	}
+
+	for (i = 0; i < r.njobs; i++)
+		free(r.jobs[i].durations);
+	free(r.jobs);
+	free(fifo);
+	free(order);
+
+	return 0;
+}
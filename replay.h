@@ -0,0 +1,6 @@
+#ifndef _JOBQUEUE_REPLAY_H_
+#define _JOBQUEUE_REPLAY_H_
+
+int replay(const char *fname, int nplaces, int maxissue);
+
+#endif
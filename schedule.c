@@ -12,74 +12,169 @@
 #include <stdint.h>
 #include <sys/wait.h>
 #include <sys/time.h>
+#include <sys/resource.h>
 #include <math.h>
 #include <assert.h>
-#include <time.h>
 
+#include "adaptive.h"
+#include "affinity.h"
+#include "admission.h"
+#include "attributes.h"
+#include "cache.h"
+#include "eta.h"
+#include "eventlog.h"
+#include "executor.h"
+#include "jobcount.h"
 #include "jobqueue.h"
+#include "journal.h"
+#include "metrics.h"
+#include "pin.h"
+#include "progress.h"
+#include "recovery.h"
 #include "schedule.h"
+#include "selfprofile.h"
+#include "shmstats.h"
+#include "speculate.h"
+#include "stats.h"
 #include "support.h"
+#include "timeout.h"
+#include "trace.h"
 #include "queue.h"
 
-enum job_result {
-	JOB_SUCCESS = 0,
-	JOB_FAILURE,
-	JOB_BROKEN_EXECUTION_PLACE,
-	JOB_RESULT_MAXIMUM
-};
+/* A place is broken after this many jobs in a row time out on it */
+#define TIMEOUTS_TO_BREAK_PLACE 3
 
-struct job {
-	size_t jobnumber;
-	char *cmd;
-	int retries;
-};
+static struct vplist failedjobs = VPLIST_INITIALIZER;
 
-struct job_ack {
-	struct job *job;
-	int place;
-	enum job_result result;
-};
+/* A job that admission control or choose_place() did not let start yet */
+static struct job *heldjob;
 
-struct executionplace {
-	int jobsrunning;
-	int maxissue;
-	int broken;
-};
+/* Jobs that wait for the execution place of their affinity key. At most
+ * maxdelayed jobs wait at a time. */
+static struct vplist delayedjobs = VPLIST_INITIALIZER;
+static size_t ndelayed;
+static size_t maxdelayed;
 
-#define ETAENTRIES 10
-static time_t etaarray[ETAENTRIES];
-static int etaind;
+/* Stragglers get speculative copies if speculating != 0. Cancelled copies
+ * that have not been reported yet are counted in ncancelled. */
+static int speculating;
+static size_t ncancelled;
 
-static struct vplist failedjobs = VPLIST_INITIALIZER;
+/* Number of running jobs that have a time limit */
+static size_t ntimedjobs;
 
-static void compute_eta(size_t jobsdone)
+/* Number of running probe commands (see --probe) */
+static size_t nprobes;
+
+/* Returns the total number of jobs, or 0 if it is not known */
+static size_t total_jobs(void)
 {
-	int i;
-	unsigned long d = 0;
-	time_t a, b;
-	double eta;
-	int nsums = 0;
+	/* With -c auto, the number of jobs is known when counting is done */
+	if (compute_eta_jobs == 0)
+		return jobcount_result();
 
-	if (compute_eta_jobs <= jobsdone)
+	return compute_eta_jobs;
+}
+
+static void compute_eta(size_t jobsdone, struct executionplace *places,
+			int nplaces)
+{
+	struct etaestimate est;
+	size_t njobs = total_jobs();
+
+	if (njobs <= jobsdone)
 		return;
 
-	etaarray[etaind] = time(NULL);
-	etaind = (etaind + 1) % ETAENTRIES;
+	if (eta_estimate(&est, jobsdone, njobs, places, nplaces))
+		return;
 
-	for (i = 0; i < ETAENTRIES; i++) {
-		a = etaarray[i];
-		b = etaarray[(i + 1) % ETAENTRIES];
-		if (a == 0 || b == 0 || b < a)
-			continue;
-		d += b - a;
-		nsums++;
-	}
+	shmstats_eta(&est);
 
-	if (d == 0)
+	/* The progress meter shows ETA instead */
+	if (progress_enabled())
 		return;
 
-	eta = (((double) (compute_eta_jobs - jobsdone)) * d) / nsums;
-	fprintf(stderr, "Completed %zu/%zu jobs: ETA %.0fs\n", jobsdone, compute_eta_jobs, eta);
+	fprintf(stderr, "Completed %zu/%zu jobs (%.2f jobs/s): ETA %.0fs (%.0f-%.0fs)\n",
+		jobsdone, njobs, est.rate, est.eta, est.low,
+		est.high);
+}
+
+/* Returns milliseconds until the next periodic output, or -1 if there is
+ * no periodic output */
+static int min_timeout(int a, int b)
+{
+	if (a < 0)
+		return b;
+	if (b < 0)
+		return a;
+
+	return (a < b) ? a : b;
+}
+
+/* Returns milliseconds until the delay of a job that waits for the place
+ * of its affinity key passes, or -1. Delays only matter when some place has
+ * a free slot. Otherwise the wait ends when a job finishes. */
+static int delay_timeout(const struct executionplace *places, int nplaces)
+{
+	struct vplist *node;
+	struct job *job;
+	uint64_t now;
+	uint64_t next = UINT64_MAX;
+	uint64_t waited;
+	int pind;
+
+	for (pind = 0; pind < nplaces; pind++) {
+		if (places[pind].jobsrunning < places[pind].maxissue)
+			break;
+	}
+
+	if (pind == nplaces)
+		return -1;
+
+	now = monotonic_ns();
+
+	VPLIST_FOR_EACH(node, &delayedjobs) {
+		job = node->item;
+		waited = now - job->waitstart;
+		if (waited >= affinitydelay)
+			return 0;
+
+		if (affinitydelay - waited < next)
+			next = affinitydelay - waited;
+	}
+
+	if (next == UINT64_MAX)
+		return -1;
+
+	/* Round up, so that the delay has passed when the wait ends */
+	return (next + 999999) / 1000000;
+}
+
+/* Returns milliseconds until the next periodic output, admission check,
+ * straggler, time limit, probe or affinity delay, or -1 if there is
+ * nothing periodic */
+static int periodic_timeout(const struct executionplace *places, int nplaces)
+{
+	int timeout;
+
+	timeout = min_timeout(progress_timeout(), metrics_timeout());
+	timeout = min_timeout(timeout, admission_timeout());
+
+	if (speculating)
+		timeout = min_timeout(timeout,
+				      speculate_timeout(places, nplaces));
+
+	if (ntimedjobs > 0)
+		timeout = min_timeout(timeout, timeout_next(places, nplaces));
+
+	if (recoverplaces)
+		timeout = min_timeout(timeout,
+				      recovery_timeout(places, nplaces));
+
+	if (ndelayed > 0)
+		timeout = min_timeout(timeout, delay_timeout(places, nplaces));
+
+	return timeout;
 }
 
 static void free_job(struct job *job)
@@ -109,99 +204,306 @@ static int test_job_restart(struct job *job)
 }
 
 
-static void read_job_ack(size_t *jobsdone, int fd,
+/* Settle an execution of a job that has a speculative copy. Returns 1 if
+ * the execution does not count: the other copy succeeded first, or this
+ * one failed while the other one may still succeed. */
+static int settle_copies(struct executor *executor,
+			 const struct job_ack *joback)
+{
+	struct job *job = joback->job;
+	struct job *other = job->copy;
+
+	if (job->cancelled) {
+		ncancelled--;
+	} else if (other != NULL && joback->result != JOB_SUCCESS) {
+		other->copy = NULL;
+	} else {
+		if (other != NULL) {
+			/* The first copy to succeed wins */
+			if (VERBOSE)
+				fprintf(stderr, "Job %zd: killing the slower copy\n",
+					job->jobnumber);
+
+			job->copy = NULL;
+			other->copy = NULL;
+			other->cancelled = 1;
+			ncancelled++;
+			executor->kill(executor, other);
+		}
+
+		return 0;
+	}
+
+	progress_job_cancel(joback->place);
+	shmstats_job_cancel(joback->place);
+
+	free_job(job);
+
+	return 1;
+}
+
+
+static void print_place(int pind)
+{
+	struct machine *machine;
+
+	if (!vplist_is_empty(&machinelist)) {
+		machine = vplist_get(&machinelist, pind);
+		assert(machine != NULL);
+		fprintf(stderr, "Execution place %s ", machine->name);
+	} else {
+		fprintf(stderr, "Execution place %d ", pind + 1);
+	}
+}
+
+
+static void mark_place_broken(struct executionplace *places, int pind)
+{
+	/* The execution place is broken, prevent new jobs to it */
+	places[pind].broken = 1;
+	places[pind].jobsrunning = places[pind].maxissue;
+
+	trace_place_broken(pind);
+	eventlog_record(EVENT_PLACE_BROKEN, -1, pind, -1, 0);
+	shmstats_place_broken(pind);
+
+	print_place(pind);
+	fprintf(stderr, "is broken.\n"
+		"Not issuing new jobs for that place.\n");
+
+	if (recoverplaces)
+		fprintf(stderr, "Probing it again in %gs.\n",
+			recovery_place_broken(pind));
+}
+
+
+/* Put a broken place back in use. Jobs that still run on the place keep
+ * their slots. */
+static void restore_place(struct executionplace *places, int pind)
+{
+	struct executionplace *place = &places[pind];
+	int slot;
+
+	place->broken = 0;
+	place->timeouts = 0;
+
+	place->jobsrunning = 0;
+	for (slot = 0; slot < place->nslots; slot++)
+		place->jobsrunning += (place->slots[slot] != NULL);
+
+	recovery_place_restored(pind);
+	trace_place_restored(pind);
+	eventlog_record(EVENT_PLACE_RESTORED, -1, pind, -1, 0);
+	shmstats_place_restored(pind);
+
+	print_place(pind);
+	fprintf(stderr, "works again.\n"
+		"Issuing new jobs for that place.\n");
+}
+
+
+/* Account a finished probe command or canary job. The place is restored
+ * if the probe succeeded, or the canary job did not report a broken place
+ * and did not time out. Returns 1 if the job was a probe command, which
+ * is not a job of the queue. */
+static int end_probe(struct executionplace *places,
+		     const struct job_ack *joback)
+{
+	struct job *job = joback->job;
+	int pind = joback->place;
+	int healthy;
+	int cancelled = job->cancelled;
+
+	places[pind].probe = NULL;
+
+	if (probecommand != NULL) {
+		healthy = (joback->result == JOB_SUCCESS);
+		nprobes--;
+		free_job(job);
+	} else {
+		healthy = (joback->result != JOB_BROKEN_EXECUTION_PLACE &&
+			   !job->timedout);
+	}
+
+	if (healthy) {
+		restore_place(places, pind);
+	} else if (!cancelled) {
+		print_place(pind);
+		fprintf(stderr, "is still broken.\n"
+			"Probing it again in %gs.\n",
+			recovery_probe_failed(pind));
+	}
+
+	return probecommand != NULL;
+}
+
+
+/* Kill running jobs that are over their time limit */
+static void kill_timed_out_jobs(struct executor *executor,
+				struct executionplace *places, int nplaces)
+{
+	struct job *job;
+	int pind;
+
+	while ((job = timeout_expired(places, nplaces, &pind)) != NULL) {
+		fprintf(stderr, "Job %zd timed out after %gs on execution place %d: %s\n",
+			job->jobnumber, job->timeout / 1000000000.0, pind + 1,
+			job->cmd);
+
+		eventlog_record(EVENT_TIMEOUT, job->jobnumber, pind, job->slot,
+				0);
+
+		job->timedout = 1;
+		executor->kill(executor, job);
+	}
+}
+
+
+/* Account a job that was killed for its time limit. A place where jobs
+ * time out repeatedly is broken, like a place where jobs exit with 2. */
+static void job_timed_out(struct executionplace *places, int pind,
+			  struct job *job)
+{
+	struct executionplace *place = &places[pind];
+
+	job->avoidplace = pind;
+
+	place->timeouts++;
+
+	if (requeuefailedjobs && !place->broken &&
+	    place->timeouts >= TIMEOUTS_TO_BREAK_PLACE)
+		mark_place_broken(places, pind);
+}
+
+
+static void read_job_ack(size_t *jobsdone, struct executor *executor,
 			 struct executionplace *places, int nplaces)
 {
 	struct job_ack joback;
-	ssize_t ret;
+	int ret;
 	struct executionplace *place;
-	struct machine *machine;
 	int jobdone;
+	uint64_t waitstart;
 
-	ret = read(fd, &joback, sizeof joback);
-	if (ret < 0) {
-		if (errno == EAGAIN || errno == EINTR)
-			return;
+	selfprofile_phase(SELFPROFILE_WAIT);
 
-		die("read %zd: %s)\n", ret, strerror(errno));
-	} else if (ret == 0) {
-		die("Job queue pipe was broken\n");
-	}
+	waitstart = monotonic_ns();
 
-	if (ret != sizeof(joback))
-		die("Unaligned read: returned %zd\n", ret);
+	/* Wake up for the progress meter and metrics */
+	ret = executor->wait(executor, &joback,
+			     periodic_timeout(places, nplaces));
+	stats_idle(monotonic_ns() - waitstart);
 
-	assert(joback.place < nplaces);
+	selfprofile_phase(SELFPROFILE_ACK);
 
-	place = &places[joback.place];
+	if (!ret)
+		return;
 
-	if (requeuefailedjobs && joback.result == JOB_BROKEN_EXECUTION_PLACE) {
-		/* The execution place is broken, prevent new jobs to it */
-		place->broken = 1;
+	assert(joback.place < nplaces);
 
-		if (!vplist_is_empty(&machinelist)) {
-			machine = vplist_get(&machinelist, joback.place);
-			assert(machine != NULL);
-			fprintf(stderr, "Execution place %s ", machine->name);
-		} else {
-			fprintf(stderr, "Execution place %d ", joback.place + 1);
-		}
+	place = &places[joback.place];
 
-		fprintf(stderr, "is broken.\n"
-			"Not issuing new jobs for that place.\n");
-	}
+	if (requeuefailedjobs && joback.result == JOB_BROKEN_EXECUTION_PLACE &&
+	    !place->broken)
+		mark_place_broken(places, joback.place);
 
 	assert(place->jobsrunning > 0);
 
-	if (place->broken)
-		place->jobsrunning = place->maxissue;
-	else
+	assert(place->slots[joback.job->slot] == joback.job);
+	place->slots[joback.job->slot] = NULL;
+
+	/* A broken place keeps jobsrunning at maxissue, or at maxissue - 1
+	   while it waits for a canary */
+	if (!place->broken)
 		place->jobsrunning--;
 
+	if (joback.job == place->probe && end_probe(places, &joback))
+		return;
+
+	admission_job_ack(joback.job);
+
+	if (joback.job->timeout)
+		ntimedjobs--;
+
+	if (settle_copies(executor, &joback))
+		return;
+
+	if (joback.job->timedout && joback.result != JOB_SUCCESS)
+		job_timed_out(places, joback.place, joback.job);
+	else if (joback.result == JOB_SUCCESS)
+		place->timeouts = 0;
+
+	joback.job->timedout = 0;
+
+	stats_job_ack(&joback);
+	eta_job_ack(&joback);
+	trace_job_ack(&joback);
+	eventlog_record(EVENT_ACK, joback.job->jobnumber, joback.place,
+			joback.job->slot, joback.result);
+
+	if (adaptive_job_ack(place, &joback)) {
+		shmstats_maxissue(joback.place, place->maxissue);
+
+		if (VERBOSE)
+			fprintf(stderr, "Execution place %d runs at most %d jobs\n",
+				joback.place + 1, place->maxissue);
+	}
+
 	if (requeuefailedjobs) {
-		if (joback.result == JOB_SUCCESS)
+		if (joback.result == JOB_SUCCESS) {
 			jobdone = 1;
-		else
+		} else {
 			jobdone = test_job_restart(joback.job);
+			if (!jobdone) {
+				trace_retry(&joback);
+				eventlog_record(EVENT_RETRY,
+						joback.job->jobnumber,
+						joback.place, joback.job->slot,
+						joback.job->retries);
+			}
+		}
 	} else {
 		/* jobdone is TRUE in no-restart mode */
 		jobdone = 1;
 	}
 
+	progress_job_ack(&joback, jobdone);
+	shmstats_job_ack(&joback, jobdone);
+	metrics_job_ack(&joback, jobdone);
+
 	if (VERBOSE)
 		fprintf(stderr, "Job %zd finished %s\n", joback.job->jobnumber,
 			joback.result == JOB_SUCCESS ?
 			"successfully" : "unsuccessfully");
 
 	if (jobdone) {
+		if (joback.result == JOB_SUCCESS && joback.job->cachekey)
+			cache_insert(joback.job->cachekey);
+
+		journal_record(joback.job->jobnumber, joback.job->fileindex,
+			       joback.job->offset, joback.result);
+
 		free_job(joback.job);
 		joback.job = NULL;
 		(*jobsdone)++;
-		compute_eta(*jobsdone);
+		compute_eta(*jobsdone, places, nplaces);
 	}
 }
 
 
-static void write_job_ack(int fd, struct job_ack joback, const char *cmd)
-{
-	ssize_t ret;
-
-	/* pipe(7) guarantees write atomicity when size <= PIPE_BUF */
-	assert(sizeof(joback) <= PIPE_BUF);
-
-	ret = write(fd, &joback, sizeof joback);
-	if (ret < 0)
-		die("PS %d job ack failed: %s\n", joback.place, cmd);
-
-	if (ret != sizeof(joback))
-		die("Unaligned write: returned %zd\n", ret);
-}
-
-
-static struct job *read_job(size_t *jobsread, struct jobqueue *queue)
+static struct job *read_job(size_t *jobsread, size_t *jobsdone,
+			    struct jobqueue *queue)
 {
 	struct job *job;
 	char cmd[MAX_CMD_SIZE];
+	uint64_t cachekey = 0;
+	int cmdoffset;
+
+	if (heldjob != NULL) {
+		job = heldjob;
+		heldjob = NULL;
+		return job;
+	}
 
 	job = vplist_pop_head(&failedjobs);
 	if (job != NULL) {
@@ -209,8 +511,40 @@ static struct job *read_job(size_t *jobsread, struct jobqueue *queue)
 		return job;
 	}
 
-	if (!queue->next(cmd, sizeof cmd, queue))
-		return NULL;
+	while (1) {
+		selfprofile_phase(SELFPROFILE_INPUT);
+
+		if (!queue->next(cmd, sizeof cmd, queue))
+			return NULL;
+
+		selfprofile_phase(SELFPROFILE_FILTER);
+
+		if (journal_is_done(*jobsread)) {
+			/* The job was finished in a previous run */
+			(*jobsread)++;
+			(*jobsdone)++;
+			continue;
+		}
+
+		if (cachefile == NULL)
+			break;
+
+		cachekey = cache_key(cmd);
+		if (!cache_lookup(cachekey))
+			break;
+
+		/* The same job has succeeded before */
+		if (VERBOSE)
+			fprintf(stderr, "Job %zd is cached: %s\n", *jobsread, cmd);
+
+		journal_record(*jobsread, queue->fileindex, queue->offset,
+			       JOB_SUCCESS);
+
+		(*jobsread)++;
+		(*jobsdone)++;
+	}
+
+	selfprofile_phase(SELFPROFILE_ALLOC);
 
 	job = malloc(sizeof job[0]);
 	if (job == NULL)
@@ -218,7 +552,14 @@ static struct job *read_job(size_t *jobsread, struct jobqueue *queue)
 
 	*job = (struct job) {.jobnumber = *jobsread,
 			     .retries = 0,
-			     .cmd = strdup(cmd)};
+			     .fileindex = queue->fileindex,
+			     .offset = queue->offset,
+			     .cachekey = cachekey,
+			     .timeout = jobtimeout,
+			     .avoidplace = -1};
+
+	cmdoffset = parse_job_attributes(job, cmd);
+	job->cmd = strdup(cmd + cmdoffset);
 
 	if (job->cmd == NULL)
 		die("Can not allocate memory for cmd: %s\n", cmd);
@@ -229,55 +570,234 @@ static struct job *read_job(size_t *jobsread, struct jobqueue *queue)
 }
 
 
-static void run(struct job *job, int ps, int fd)
+static int allocate_slot(struct executionplace *place, struct job *job)
 {
-	ssize_t ret;
-	char cmd[MAX_CMD_SIZE];
-	struct job_ack joback = {.job = job,
-				 .place = ps,
-	                         .result = JOB_FAILURE};
-	struct machine *m;
+	int slot;
 
-	if (!vplist_is_empty(&machinelist)) {
-		m = vplist_get(&machinelist, ps);
-		assert(m != NULL);
+	for (slot = 0; slot < place->nslots; slot++) {
+		if (place->slots[slot] == NULL) {
+			place->slots[slot] = job;
+			return slot;
+		}
+	}
 
-		ret = snprintf(cmd, sizeof cmd, "%s %s", job->cmd, m->name);
-	} else if (passexecutionplace) {
-		ret = snprintf(cmd, sizeof cmd, "%s %d", job->cmd, ps + 1);
-	} else {
-		ret = snprintf(cmd, sizeof cmd, "%s", job->cmd);
+	die("No free slot in an execution place\n");
+}
+
+
+static void dispatch_job(struct executor *executor,
+			 struct executionplace *places, int pind,
+			 struct job *job)
+{
+	places[pind].jobsrunning++;
+
+	job->slot = allocate_slot(&places[pind], job);
+
+	/* A broken place was opened for one job by probe_broken_places() */
+	if (places[pind].broken)
+		places[pind].probe = job;
+
+	job->dispatchtime = monotonic_ns();
+
+	if (job->timeout)
+		ntimedjobs++;
+
+	affinity_dispatch(job, pind);
+
+	admission_dispatch(job);
+	progress_dispatch(pind);
+	shmstats_dispatch(pind);
+	metrics_dispatch();
+	eventlog_record(EVENT_DISPATCH, job->jobnumber, pind, job->slot,
+			job->retries);
+
+	selfprofile_phase(SELFPROFILE_START);
+
+	executor->start(executor, job, pind);
+
+	selfprofile_phase(SELFPROFILE_LOOP);
+}
+
+
+/* Returns the place for job when place pind has a free slot. A job that
+ * timed out on pind is moved to another place. Returns -1 if the job
+ * should wait for another place to have a free slot. */
+static int choose_place(const struct executionplace *places, int nplaces,
+			int pind, const struct job *job)
+{
+	int i;
+	int otherplaces = 0;
+
+	if (job->avoidplace != pind)
+		return pind;
+
+	for (i = 0; i < nplaces; i++) {
+		if (i == pind || places[i].broken)
+			continue;
+
+		if (places[i].jobsrunning < places[i].maxissue)
+			return i;
+
+		otherplaces = 1;
 	}
 
-	if (ret >= sizeof(cmd)) {
-		write_job_ack(fd, joback, cmd);
-		die("Too long a command: %s\n", job->cmd);
+	return otherplaces ? -1 : pind;
+}
+
+
+/* Delay scheduling for affinity keys. A job whose key last ran on another
+ * place than pind goes to that place if it has a free slot. If the place
+ * is full, the job is put aside to wait for it, and 1 is returned. A job
+ * waits at most once, and not at all if the place is broken. */
+static int delay_job(const struct executionplace *places, int *pind,
+		     struct job *job)
+{
+	int keyplace = affinity_place(job);
+
+	if (keyplace < 0 || keyplace == *pind || places[keyplace].broken)
+		return 0;
+
+	if (places[keyplace].jobsrunning < places[keyplace].maxissue) {
+		*pind = keyplace;
+		return 0;
 	}
 
+	if (job->waitstart != 0 || affinitydelay == 0 ||
+	    ndelayed >= maxdelayed)
+		return 0;
+
 	if (VERBOSE)
-		fprintf(stderr, "Job %zd execute: %s\n", job->jobnumber, cmd);
+		fprintf(stderr, "Job %zd waits for execution place %d\n",
+			job->jobnumber, keyplace + 1);
+
+	job->waitstart = monotonic_ns();
+
+	if (vplist_append(&delayedjobs, job))
+		die("No memory for delayed jobs\n");
+	ndelayed++;
+
+	return 1;
+}
+
+
+/* Returns a waiting job whose place has a free slot or whose delay has
+ * passed, or NULL. *pind is a free place on entry, and it is set to the
+ * place of the job's key if that place is free. */
+static struct job *take_delayed_job(const struct executionplace *places,
+				    int *pind)
+{
+	struct vplist *node;
+	struct job *job;
+	const struct executionplace *keyplace;
+	uint64_t now = monotonic_ns();
+
+	VPLIST_FOR_EACH(node, &delayedjobs) {
+		job = node->item;
+		keyplace = &places[affinity_place(job)];
+
+		if (!keyplace->broken &&
+		    keyplace->jobsrunning < keyplace->maxissue)
+			*pind = keyplace - places;
+		else if (!keyplace->broken &&
+			 now - job->waitstart < affinitydelay)
+			continue;
+
+		vplist_remove_item(&delayedjobs, job);
+		ndelayed--;
 
-	ret = system(cmd);
-	if (ret == -1) {
-		write_job_ack(fd, joback, cmd);
-		die("job delivery failed: %s\n", cmd);
+		return job;
 	}
 
-	ret = WEXITSTATUS(ret);
+	return NULL;
+}
 
-	if (ret < JOB_RESULT_MAXIMUM) {
-		joback.result = ret;
-	} else {
-		/* Mark large return code as a failure */
-		joback.result = JOB_FAILURE;
 
-		if (requeuefailedjobs)
-			fprintf(stderr, "Invalid return code %d from: %s\n"
-				"Intepreting this as a failure.\n",
-				(int) ret, cmd);
+/* Start a copy of a straggler on execution place pind */
+static void start_copy(struct executor *executor,
+		       struct executionplace *places, int pind,
+		       struct job *job)
+{
+	struct job *copy;
+
+	copy = malloc(sizeof copy[0]);
+	if (copy == NULL)
+		die("Can not allocate memory for job: %s\n", job->cmd);
+
+	*copy = *job;
+
+	copy->cmd = strdup(job->cmd);
+	if (copy->cmd == NULL)
+		die("Can not allocate memory for cmd: %s\n", job->cmd);
+
+	copy->copy = job;
+	copy->avoidplace = -1;
+	job->copy = copy;
+
+	if (VERBOSE)
+		fprintf(stderr, "Job %zd is a straggler: starting a copy\n",
+			job->jobnumber);
+
+	dispatch_job(executor, places, pind, copy);
+}
+
+
+/* Probe broken places whose backoff has passed. A probe command is
+ * started right away. Otherwise the place is opened for one job, which
+ * becomes the canary in dispatch_job(). */
+static void probe_broken_places(struct executor *executor,
+				struct executionplace *places, int nplaces)
+{
+	struct executionplace *place;
+	struct job *probe;
+	int pind;
+
+	while ((pind = recovery_due(places, nplaces)) >= 0) {
+		place = &places[pind];
+
+		if (probecommand == NULL) {
+			place->jobsrunning = place->maxissue - 1;
+			continue;
+		}
+
+		probe = calloc(1, sizeof probe[0]);
+		if (probe == NULL)
+			die("Can not allocate memory for a probe\n");
+
+		probe->jobnumber = -1;
+		probe->avoidplace = -1;
+		probe->cmd = strdup(probecommand);
+		if (probe->cmd == NULL)
+			die("Can not allocate memory for a probe\n");
+
+		probe->slot = allocate_slot(place, probe);
+		probe->dispatchtime = monotonic_ns();
+
+		place->probe = probe;
+		nprobes++;
+
+		if (VERBOSE)
+			fprintf(stderr, "Probing execution place %d: %s\n",
+				pind + 1, probe->cmd);
+
+		executor->start(executor, probe, pind);
 	}
+}
+
+
+/* Kill probe commands, because nothing else is left to do */
+static void cancel_probes(struct executor *executor,
+			  struct executionplace *places, int nplaces)
+{
+	int pind;
+
+	for (pind = 0; pind < nplaces; pind++) {
+		if (places[pind].probe == NULL ||
+		    places[pind].probe->cancelled)
+			continue;
 
-	write_job_ack(fd, joback, cmd);
+		places[pind].probe->cancelled = 1;
+		executor->kill(executor, places[pind].probe);
+	}
 }
 
 
@@ -314,6 +834,20 @@ static struct executionplace *setup_execution_places(int nplaces, int maxissue)
 			places[i].maxissue = maxissue;
 	}
 
+	for (i = 0; i < nplaces; i++) {
+		places[i].nslots = places[i].maxissue;
+		if (adaptivemax > places[i].nslots)
+			places[i].nslots = adaptivemax;
+
+		places[i].slots = calloc(places[i].nslots,
+					 sizeof places[i].slots[0]);
+		if (places[i].slots == NULL)
+			die("No memory for execution place slots\n");
+	}
+
+	if (adaptivemax)
+		adaptive_init(places, nplaces);
+
 	return places;
 }
 
@@ -322,25 +856,79 @@ void schedule(int nplaces, struct jobqueue *queue, int maxissue)
 {
 	struct executionplace *places;
 	int pind;
-	int ackpipe[2];
+	struct executor *executor;
 	size_t jobsread = 0;
 	size_t jobsdone = 0;
+	size_t njobs;
 	int exitmode = 0;
 	struct job *job;
 	int allbroken;
-	pid_t child;
 	int somethingtoissue;
 	int possibletoissue;
 	int somethingtowait;
 
 	assert(nplaces > 0);
 
-	if (pipe_closeonexec(ackpipe))
-		die("Can not create a pipe: %s\n", strerror(errno));
+	if (fakeexecutor)
+		executor = fake_executor_create(fakeexecutorspec);
+	else
+		executor = process_executor_create();
 
 	places = setup_execution_places(nplaces, maxissue);
 
+	for (pind = 0; pind < nplaces; pind++)
+		maxdelayed += places[pind].nslots;
+
+	stats_init(nplaces);
+	eta_init(nplaces);
+
+	if (tracefile != NULL)
+		trace_open(tracefile);
+
+	if (eventlogfile != NULL)
+		eventlog_open(eventlogfile);
+
+	if (journalfile != NULL) {
+		jobsread = journal_open(journalfile, resumejournal, queue);
+		jobsdone = jobsread;
+	}
+
+	if (cachefile != NULL)
+		cache_open(cachefile);
+
+	if (publishshmstats)
+		shmstats_open(places, nplaces);
+
+	if (admission)
+		admission_init(admissionspec);
+
+	if (pinspec != NULL)
+		pin_init(pinspec, places, nplaces);
+
+	if (recoverplaces)
+		recovery_init(recoverspec, nplaces);
+
+	if (metricsfile != NULL)
+		metrics_open(metricsfile, nplaces);
+
+	progress_init(nplaces, jobsdone);
+	selfprofile_init();
+
 	while (1) {
+		selfprofile_phase(SELFPROFILE_OUTPUT);
+
+		njobs = total_jobs();
+
+		progress_update(jobsdone, njobs, places, nplaces);
+		shmstats_jobs(jobsread, jobsdone, njobs);
+		metrics_update(jobsdone, places, nplaces);
+		eventlog_check_signal();
+
+		selfprofile_phase(SELFPROFILE_LOOP);
+
+		if (recoverplaces)
+			probe_broken_places(executor, places, nplaces);
+
 		/* Find a free execution place */
 		allbroken = 1;
 
@@ -352,14 +940,38 @@ void schedule(int nplaces, struct jobqueue *queue, int maxissue)
 				break;
 		}
 
-		if (allbroken)
+		/* Broken places may recover if they are probed */
+		if (allbroken && !recoverplaces)
 			die("ALL EXECUTION PLACES HAVE DIED\n");
 
 		possibletoissue = (pind < nplaces);
 
-		somethingtoissue = (!vplist_is_empty(&failedjobs) || !exitmode);
+		somethingtoissue = (heldjob != NULL ||
+				    !vplist_is_empty(&failedjobs) || !exitmode ||
+				    ndelayed > 0);
+
+		somethingtowait = (jobsdone < jobsread || ncancelled > 0);
+
+		/* Probes do not keep the run going */
+		if (nprobes > 0) {
+			if (!somethingtoissue && !somethingtowait)
+				cancel_probes(executor, places, nplaces);
+			somethingtowait = 1;
+		}
+
+		if (ntimedjobs > 0)
+			kill_timed_out_jobs(executor, places, nplaces);
 
-		somethingtowait = (jobsdone < jobsread);
+		/* Copy stragglers when there is nothing else to start */
+		speculating = (speculatefactor > 0 && !somethingtoissue);
+
+		if (speculating && possibletoissue) {
+			job = speculate_find(places, nplaces, &pind);
+			if (job != NULL) {
+				start_copy(executor, places, pind, job);
+				continue;
+			}
+		}
 
 		/* Finite state machine for job handling
 		 *
@@ -380,26 +992,48 @@ void schedule(int nplaces, struct jobqueue *queue, int maxissue)
 
 		/* States 6 and 7 */
 		if (possibletoissue && somethingtoissue) {
-			job = read_job(&jobsread, queue);
-			if (job == NULL) {
-				exitmode = 1; /* No more jobs -> exit mode */
+			job = NULL;
+
+			if (ndelayed > 0 && heldjob == NULL)
+				job = take_delayed_job(places, &pind);
+
+			if (job == NULL && heldjob == NULL &&
+			    vplist_is_empty(&failedjobs) &&
+			    (exitmode || ndelayed >= maxdelayed)) {
+				/* Only waiting jobs are left to issue */
+				read_job_ack(&jobsdone, executor, places,
+					     nplaces);
 				continue;
 			}
 
-			places[pind].jobsrunning++;
-
-			child = fork();
-			if (child == 0) {
-				/* Close some child file descriptors */
-				close(0);
-				close(ackpipe[0]);
+			if (job == NULL) {
+				job = read_job(&jobsread, &jobsdone, queue);
+				selfprofile_phase(SELFPROFILE_LOOP);
+
+				if (job == NULL) {
+					eventlog_record(EVENT_QUEUE_EXHAUSTED,
+							-1, -1, -1, jobsread);
+					adaptive_queue_exhausted();
+					exitmode = 1; /* No more jobs -> exit mode */
+					continue;
+				}
+
+				if (job->affinity &&
+				    delay_job(places, &pind, job))
+					continue;
+			}
 
-				run(job, pind, ackpipe[1]);
+			pind = choose_place(places, nplaces, pind, job);
 
-				exit(0);
-			} else if (child < 0) {
-				die("Can not fork()\n");
+			if (pind < 0 || !admission_allow(job)) {
+				/* Wait for another place or for memory */
+				heldjob = job;
+				read_job_ack(&jobsdone, executor, places,
+					     nplaces);
+				continue;
 			}
+
+			dispatch_job(executor, places, pind, job);
 			continue;
 		}
 
@@ -408,9 +1042,24 @@ void schedule(int nplaces, struct jobqueue *queue, int maxissue)
 			break;
 
 		/* States 1, 2, 3, 5 */
-		read_job_ack(&jobsdone, ackpipe[0], places, nplaces);
+		read_job_ack(&jobsdone, executor, places, nplaces);
 	}
 
+	executor->close(executor);
+
+	progress_close(jobsdone, total_jobs(), places, nplaces);
+
+	eventlog_close();
+	metrics_close(jobsdone, places, nplaces);
+	shmstats_close();
+	journal_close();
+	cache_close();
+	stats_close();
+	trace_close();
+
 	if (VERBOSE)
 		fprintf(stderr, "All jobs done (%zd)\n", jobsdone);
+
+	stats_report();
+	selfprofile_report();
 }
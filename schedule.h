@@ -1,8 +1,92 @@
 #ifndef _JOBQUEUE_SCHEDULE_H_
 #define _JOBQUEUE_SCHEDULE_H_
 
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+
 #include "queue.h"
 
+enum job_result {
+	JOB_SUCCESS = 0,
+	JOB_FAILURE,
+	JOB_BROKEN_EXECUTION_PLACE,
+	JOB_RESULT_MAXIMUM
+};
+
+struct job {
+	size_t jobnumber;
+	char *cmd;
+	int retries;
+
+	/* Job queue position after this job (see struct jobqueue) */
+	size_t fileindex;
+	off_t offset;
+
+	/* Result cache key, or 0 if the cache is not used */
+	uint64_t cachekey;
+
+	/* Memory hint in bytes from job attributes, or 0 */
+	uint64_t mem;
+
+	/* Time limit of an execution in ns, or 0. timedout != 0 if the
+	   running execution was killed for going over the limit. A job that
+	   timed out avoids avoidplace when it is requeued (-1 for none). */
+	uint64_t timeout;
+	int timedout;
+	int avoidplace;
+
+	/* Hash of the affinity key from job attributes, or 0. waitstart is
+	   the monotonic_ns() time when the job was put aside to wait for
+	   the place of its key, or 0 if it has not waited. */
+	uint64_t affinity;
+	uint64_t waitstart;
+
+	/* monotonic_ns() time when the job was last issued, and the slot of
+	   the execution place that runs it */
+	uint64_t dispatchtime;
+	int slot;
+
+	/* Runner process of the process executor */
+	pid_t runner;
+
+	/* A speculative copy of the job that is running at the same time,
+	   or NULL. A copy that lost is cancelled, and its result is
+	   ignored. */
+	struct job *copy;
+	int cancelled;
+};
+
+struct job_ack {
+	struct job *job;
+	int place;
+	enum job_result result;
+
+	/* monotonic_ns() times around the job command, and resource usage
+	   of the command */
+	uint64_t start;
+	uint64_t end;
+	struct rusage rusage;
+};
+
+struct executionplace {
+	int jobsrunning;
+	int maxissue;
+	int broken;
+
+	/* Number of jobs that timed out in a row on the place */
+	int timeouts;
+
+	/* The probe command or canary job that runs on a broken place to
+	   see if it works again, or NULL (see recovery.c) */
+	struct job *probe;
+
+	/* slots[i] is the job running in slot i, or NULL. There are nslots
+	   slots, which is more than maxissue if maxissue is adaptive. */
+	struct job **slots;
+	int nslots;
+};
+
 void schedule(int nprocesses, struct jobqueue *queue, int maxissue);
 
 #endif
@@ -0,0 +1,126 @@
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "jobqueue.h"
+#include "selfprofile.h"
+#include "support.h"
+
+/* Time of the scheduler loop is split into phases. Switching the phase
+ * reads the time stamp counter once, and adds the elapsed ticks to the
+ * previous phase, so a job costs a few counter reads. Ticks are converted
+ * to seconds by comparing to the monotonic clock over the whole run.
+ */
+
+static int enabled;
+static enum selfprofile_phase currentphase;
+static uint64_t lastticks;
+static uint64_t ticks[SELFPROFILE_NPHASES];
+static uint64_t entries[SELFPROFILE_NPHASES];
+
+static uint64_t startticks;
+static uint64_t startns;
+
+static const char *phasenames[SELFPROFILE_NPHASES] = {
+	[SELFPROFILE_LOOP] = "loop",
+	[SELFPROFILE_INPUT] = "input",
+	[SELFPROFILE_FILTER] = "journal/cache",
+	[SELFPROFILE_ALLOC] = "job alloc",
+	[SELFPROFILE_START] = "start",
+	[SELFPROFILE_WAIT] = "wait",
+	[SELFPROFILE_ACK] = "ack",
+	[SELFPROFILE_OUTPUT] = "output",
+};
+
+
+static inline uint64_t read_ticks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return monotonic_ns();
+#endif
+}
+
+
+void selfprofile_init(void)
+{
+	if (!selfprofiling)
+		return;
+
+	enabled = 1;
+	currentphase = SELFPROFILE_LOOP;
+	startns = monotonic_ns();
+	startticks = read_ticks();
+	lastticks = startticks;
+}
+
+
+void selfprofile_phase(enum selfprofile_phase phase)
+{
+	uint64_t now;
+
+	if (!enabled)
+		return;
+
+	now = read_ticks();
+	ticks[currentphase] += now - lastticks;
+	lastticks = now;
+
+	currentphase = phase;
+	entries[phase]++;
+}
+
+
+void selfprofile_report(void)
+{
+	uint64_t totalticks;
+	uint64_t overheadticks = 0;
+	uint64_t ndispatched = entries[SELFPROFILE_START];
+	double wall;
+	double nspertick;
+	double overhead;
+	int i;
+
+	if (!enabled)
+		return;
+
+	selfprofile_phase(SELFPROFILE_LOOP);
+
+	wall = (monotonic_ns() - startns) / 1000000000.0;
+	totalticks = lastticks - startticks;
+	nspertick = totalticks ? wall * 1000000000.0 / totalticks : 0;
+
+	for (i = 0; i < SELFPROFILE_NPHASES; i++) {
+		if (i != SELFPROFILE_WAIT)
+			overheadticks += ticks[i];
+	}
+
+	overhead = overheadticks * nspertick / 1000000000.0;
+
+	fprintf(stderr, "\nScheduler self-profile: %llu dispatches, %.3fs wall time\n",
+		(unsigned long long) ndispatched, wall);
+	fprintf(stderr, "  %-14s %10s %8s %12s %14s\n", "phase", "seconds",
+		"share", "entries", "us/dispatch");
+
+	for (i = 0; i < SELFPROFILE_NPHASES; i++) {
+		fprintf(stderr, "  %-14s %10.6f %7.2f%% %12llu %14.3f\n",
+			phasenames[i], ticks[i] * nspertick / 1000000000.0,
+			totalticks ? 100.0 * ticks[i] / totalticks : 0.0,
+			(unsigned long long) entries[i],
+			ndispatched ? ticks[i] * nspertick / 1000.0 / ndispatched : 0.0);
+	}
+
+	fprintf(stderr, "  Overhead (all but wait): %.6fs, %.3f us per dispatch\n",
+		overhead, ndispatched ? overhead * 1000000.0 / ndispatched : 0.0);
+
+	if (ndispatched > 0 && overhead > 0)
+		fprintf(stderr, "  Maximum sustainable dispatch rate: %.0f jobs/s\n",
+			ndispatched / overhead);
+}
@@ -0,0 +1,22 @@
+#ifndef _JOBQUEUE_SELFPROFILE_H_
+#define _JOBQUEUE_SELFPROFILE_H_
+
+/* Scheduler phases. All time of the scheduler loop is accounted to the
+ * current phase. */
+enum selfprofile_phase {
+	SELFPROFILE_LOOP = 0,   /* FSM, slot allocation and dispatch hooks */
+	SELFPROFILE_INPUT,      /* Reading job lines (queue->next()) */
+	SELFPROFILE_FILTER,     /* Journal and cache checks */
+	SELFPROFILE_ALLOC,      /* Allocating struct job */
+	SELFPROFILE_START,      /* Starting a job (fork() in the parent) */
+	SELFPROFILE_WAIT,       /* Waiting for job acks */
+	SELFPROFILE_ACK,        /* Handling a job ack */
+	SELFPROFILE_OUTPUT,     /* Progress meter, metrics, stats page, events */
+	SELFPROFILE_NPHASES,
+};
+
+void selfprofile_init(void);
+void selfprofile_phase(enum selfprofile_phase phase);
+void selfprofile_report(void);
+
+#endif
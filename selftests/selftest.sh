@@ -53,3 +53,218 @@ fi
 if test $(cat tfile |grep -c bar) != "2" ; then
     echo "$name failed"
 fi
+
+name="journal resume test"
+echo "Running $name"
+for i in $(seq 10) ; do echo "echo $i" ; done > tjobs
+$com -n2 --journal=tjournal tjobs > /dev/null 2>&1
+grep -v '^[37] ' tjournal > tjournal2
+$com -n2 --resume=tjournal2 tjobs > tfile 2>/dev/null
+if test "$(sort -n tfile |tr '\n' ' ')" != "4 8 " ; then
+    echo "$name failed"
+fi
+if test $(wc -l < tjournal2) != "10" ; then
+    echo "$name failed"
+fi
+rm -f tjobs tjournal tjournal2
+
+name="result cache test"
+echo "Running $name"
+rm -f tcache
+printf 'echo a\nfalse\n' |$com --cache=tcache > /dev/null 2>&1
+printf 'echo a\nfalse\necho b\n' |$com --cache=tcache > tfile 2>/dev/null
+if test "$(cat tfile)" != "b" ; then
+    echo "$name failed"
+fi
+rm -f tcache
+
+name="automatic job count test"
+echo "Running $name"
+printf '# comment\nsleep 0.1\n\n  \nsleep 0.1\nsleep 0.1\n' > tjobs
+$com -c auto tjobs 2> tfile
+if test $(grep -c 'Completed [12]/3 jobs' tfile) != "2" ; then
+    echo "$name failed"
+fi
+rm -f tjobs
+
+name="shared memory stats test"
+echo "Running $name"
+echo "sleep 1" |$com -n1 --shm-stats &
+sleep 0.5
+$com --stat=$! > tfile
+wait
+if test $(grep -c 'running 1/1' tfile) != "1" ; then
+    echo "$name failed"
+fi
+if test -e /dev/shm/jobqueue.$! ; then
+    echo "$name failed"
+fi
+
+name="metrics file test"
+echo "Running $name"
+printf 'true\nfalse\ntrue\n' |$com -n2 --metrics-file=tmetrics
+if test $(grep -c -e '^jobqueue_jobs_started_total 3$' \
+    -e '^jobqueue_jobs_failed_total{class="failure"} 1$' \
+    -e '^jobqueue_job_duration_seconds_count 3$' tmetrics) != "3" ; then
+    echo "$name failed"
+fi
+rm -f tmetrics
+
+name="event log test"
+echo "Running $name"
+printf 'true\nfalse\n' |$com -r --max-restart=1 --event-log=tevents
+$com --decode-events=tevents > tfile
+if test $(grep -c -e ' dispatch ' -e ' retry ' -e ' queue_exhausted ' tfile) != "5" ; then
+    echo "$name failed"
+fi
+rm -f tevents
+
+name="self-profile test"
+echo "Running $name"
+printf 'true\ntrue\n' |$com --self-profile 2> tfile
+if test $(grep -c -e '^  start ' -e 'Maximum sustainable dispatch rate' tfile) != "2" ; then
+    echo "$name failed"
+fi
+
+name="fake executor test"
+echo "Running $name"
+for i in 1 2 ; do
+    yes true |head -n 2000 |$com -n8 -r --max-restart=3 \
+	--fake-executor=seed=3,mean=0.1,fail=0.05 --results=tresults$i
+    if test "$?" != "0" ; then
+	echo "$name failed"
+    fi
+done
+if ! cmp -s <(cut -d, -f1-4 tresults1) <(cut -d, -f1-4 tresults2) ; then
+    echo "$name failed"
+fi
+if test $(awk -F, '$3 == 1' tresults1 |wc -l) = "0" ; then
+    echo "$name failed"
+fi
+rm -f tresults1 tresults2
+
+name="replay test"
+echo "Running $name"
+printf '%s\n' 'jobnumber,place,result,retries,dispatch,start,end,utime,stime,maxrss,minflt,majflt,command' \
+    '0,1,0,0,0,0,3,0,0,0,0,0,"a"' '1,2,1,0,0,0,1,0,0,0,0,0,"b"' \
+    '2,2,0,0,1,1,2,0,0,0,0,0,"c"' '1,2,0,1,2,2,3,0,0,0,0,0,"b"' > tresults
+$com --replay=tresults -n2 > tfile
+if test $(grep -c -e '^  fifo  *3.000 ' -e '^  shortest  *4.000 ' tfile) != "2" ; then
+    echo "$name failed"
+fi
+$com --replay=tresults -n1 -x4 > tfile
+if test $(grep -c -e '^  fifo  *3.000  *50.0 %  *1.00$' tfile) != "1" ; then
+    echo "$name failed"
+fi
+rm -f tresults
+
+name="adaptive concurrency test"
+echo "Running $name"
+yes 'sleep 0.05' |head -n 200 |$com -n1 -v --adaptive=1:4 2> tfile
+if test $(grep -c 'Execution place 1 runs at most 4 jobs' tfile) = "0" ; then
+    echo "$name failed"
+fi
+
+name="admission control test"
+echo "Running $name"
+printf '[mem=1000T] sleep 0.3; echo a\n[mem=1000T] echo b\n' |$com -n2 --admission > tfile
+if test "$(cat tfile |tr '\n' ' ')" != "a b " ; then
+    echo "$name failed"
+fi
+
+name="pinning test"
+echo "Running $name"
+printf 'echo $JOBQUEUE_PLACE\necho $JOBQUEUE_PLACE\n' |$com -n2 --pin=core > tfile
+if test "$(sort tfile |tr '\n' ' ')" != "1 2 " ; then
+    echo "$name failed"
+fi
+echo 'grep Cpus_allowed_list /proc/self/status' |$com --pin=numa,mem=preferred > tfile 2>&1
+if test $(grep -c '^Cpus_allowed_list' tfile) != "1" ; then
+    echo "$name failed"
+fi
+
+name="speculative execution test"
+echo "Running $name"
+rm -rf tlock
+(for i in $(seq 10) ; do echo 'sleep 0.05' ; done
+ echo 'mkdir tlock 2>/dev/null && sleep 10 ; true') > tjobs
+SECONDS=0
+$com -n2 --speculate --results=tresults tjobs
+if test $SECONDS -ge 5 || test $(grep -c '^10,' tresults) != "1" ; then
+    echo "$name failed"
+fi
+rm -rf tlock tjobs tresults
+
+name="timeout test"
+echo "Running $name"
+SECONDS=0
+printf 'sleep 10\n[timeout=0.2] sleep 10\necho a\n' |$com -n2 -r --max-restart=1 --timeout=0.5 --results=tresults > /dev/null 2> tfile
+if test $SECONDS -ge 5 || test $(grep -c 'timed out' tfile) != "4" ; then
+    echo "$name failed"
+fi
+# A requeued job that timed out moves to the other place
+if test "$(awk -F, '$1 == 1 {print $2}' tresults |tr '\n' ' ')" != "2 1 " ; then
+    echo "$name failed"
+fi
+rm -f tresults
+
+name="place recovery test"
+echo "Running $name"
+# The only place breaks, and the next job is a canary that restores it
+printf 'mkdir tlock 2>/dev/null && exit 2; true\ntrue\n' |$com -n1 -r --recover=backoff=0.1 --results=tresults 2> tfile
+if test $(grep -c 'works again' tfile) != "1" || test $(grep -c ',1,0,' tresults) != "2" ; then
+    echo "$name failed"
+fi
+rm -rf tlock
+# A probe command fails until tlock exists
+(echo 'test $JOBQUEUE_PLACE = 1 && mkdir tlock 2>/dev/null && exit 2; sleep 0.1'
+ for i in $(seq 10) ; do echo 'sleep 0.1' ; done) |$com -n2 -r --probe='test -e tlock/ok' --recover=backoff=0.1 --results=tresults 2> tfile &
+sleep 0.3
+touch tlock/ok
+wait
+if test $(grep -c 'still broken' tfile) = "0" || test $(grep -c 'works again' tfile) != "1" ; then
+    echo "$name failed"
+fi
+rm -rf tlock tfile tresults
+
+name="affinity test"
+echo "Running $name"
+# Jobs of a key wait for the place that ran the key instead of taking the
+# other free place
+for i in 1 2 3 ; do
+    echo '[affinity=a] echo $JOBQUEUE_PLACE >> tfile; sleep 0.1'
+    echo '[affinity=a] echo $JOBQUEUE_PLACE >> tfile; sleep 0.1'
+    echo '[affinity=b] true; sleep 0.1'
+    echo '[affinity=b] true; sleep 0.1'
+done |$com -n2
+if test $(sort -u tfile |wc -l) != "1" || test $(wc -l < tfile) != "6" ; then
+    echo "$name failed"
+fi
+rm -f tfile
+
+name="long command trace test"
+echo "Running $name"
+# Escaping doubles the quotes of the command in the trace
+(printf 'true #' ; head -c 40000 /dev/zero |tr '\0' '"' ; echo) |$com -n1 --trace=tfile
+if test $? != "0" || test "$(tail -n1 tfile)" != "]" ; then
+    echo "$name failed"
+fi
+rm -f tfile
+
+name="long command results test"
+echo "Running $name"
+# CSV quoting doubles the quotes of the command in the results
+(printf 'true #' ; head -c 40000 /dev/zero |tr '\0' '"' ; echo) |$com -n1 --results=tfile
+if test $? != "0" || test $(wc -l < tfile) != "2" || test $(wc -c < tfile) -lt 80000 ; then
+    echo "$name failed"
+fi
+rm -f tfile
+
+name="fake executor recovery test"
+echo "Running $name"
+# Both places break, and the scheduler waits with no fake jobs running
+seq 10 |$com -n2 -r --fake-executor=broken=0.5,seed=3 --recover=backoff=0.05,max=0.1 --summary 2> tfile
+if test $? != "0" || test $(grep -c 'works again' tfile) = "0" ; then
+    echo "$name failed"
+fi
+rm -f tfile
@@ -0,0 +1,393 @@
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sched.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include "jobqueue.h"
+#include "shmstats.h"
+#include "support.h"
+
+/* Counters of a running jobqueue are published in a file that is mmap()ed
+ * from /dev/shm/jobqueue.<pid>. External monitors can read the counters
+ * without any cooperation from jobqueue. Updates are plain memory writes.
+ *
+ * The page is protected by a sequence lock: the writer increments seq to
+ * an odd value before an update and to an even value after it. A reader
+ * copies the page and retries if seq was odd or changed during the copy.
+ */
+
+#define SHMSTATS_MAGIC "JQSTATS1"
+#define SHMSTATS_DIR "/dev/shm"
+#define SHMSTATS_NAME_SIZE 32
+
+struct shmplace {
+	uint32_t running;
+	uint32_t maxissue;
+	uint32_t broken;
+	uint32_t reserved;
+	char name[SHMSTATS_NAME_SIZE];
+};
+
+struct shmstats {
+	char magic[8];
+	uint64_t seq;
+	uint64_t pid;
+	uint64_t nplaces;
+
+	/* CLOCK_MONOTONIC nanoseconds */
+	uint64_t starttime;
+	uint64_t updatetime;
+
+	uint64_t jobsread;
+	uint64_t jobsdone;
+	uint64_t jobsfailed;
+	uint64_t requeued;
+	uint64_t running;
+	uint64_t brokenplaces;
+
+	/* Total number of jobs, 0 if not known */
+	uint64_t njobs;
+
+	/* Latest ETA estimate in seconds from etatime, eta < 0 if there is
+	 * no estimate */
+	uint64_t etatime;
+	double rate;
+	double eta;
+	double etalow;
+	double etahigh;
+
+	struct shmplace places[];
+};
+
+static char shmstatsfname[PATH_MAX];
+static struct shmstats *shm;
+static size_t shmsize;
+static pid_t ownerpid;
+
+
+static size_t shmstats_size(uint64_t nplaces)
+{
+	return sizeof(struct shmstats) + nplaces * sizeof(struct shmplace);
+}
+
+
+static void shmstats_name(char *fname, size_t size, pid_t pid)
+{
+	snprintf(fname, size, "%s/jobqueue.%d", SHMSTATS_DIR, (int) pid);
+}
+
+
+static void write_begin(void)
+{
+	__atomic_store_n(&shm->seq, shm->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+
+static void write_end(void)
+{
+	shm->updatetime = monotonic_ns();
+	__atomic_store_n(&shm->seq, shm->seq + 1, __ATOMIC_RELEASE);
+}
+
+
+/* A die() path calls exit(), also in runner children */
+static void remove_shmstats(void)
+{
+	if (getpid() == ownerpid)
+		unlink(shmstatsfname);
+}
+
+
+void shmstats_open(const struct executionplace *places, int nplaces)
+{
+	struct machine *m;
+	int fd;
+	int i;
+
+	ownerpid = getpid();
+	shmstats_name(shmstatsfname, sizeof shmstatsfname, ownerpid);
+
+	fd = open(shmstatsfname, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0)
+		dieerror("Can not create %s", shmstatsfname);
+
+	shmsize = shmstats_size(nplaces);
+
+	if (ftruncate(fd, shmsize))
+		dieerror("Can not resize %s", shmstatsfname);
+
+	shm = mmap(NULL, shmsize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (shm == MAP_FAILED)
+		dieerror("Can not mmap %s", shmstatsfname);
+
+	atexit(remove_shmstats);
+
+	write_begin();
+
+	shm->pid = ownerpid;
+	shm->nplaces = nplaces;
+	shm->starttime = monotonic_ns();
+	shm->eta = -1;
+
+	for (i = 0; i < nplaces; i++) {
+		shm->places[i].maxissue = places[i].maxissue;
+
+		if (vplist_is_empty(&machinelist)) {
+			snprintf(shm->places[i].name, SHMSTATS_NAME_SIZE,
+				 "%d", i + 1);
+		} else {
+			m = vplist_get(&machinelist, i);
+			assert(m != NULL);
+			snprintf(shm->places[i].name, SHMSTATS_NAME_SIZE,
+				 "%s", m->name);
+		}
+	}
+
+	write_end();
+
+	/* The magic is written last, so a reader never sees a partial page */
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy(shm->magic, SHMSTATS_MAGIC, sizeof shm->magic);
+}
+
+
+void shmstats_jobs(size_t jobsread, size_t jobsdone, size_t njobs)
+{
+	if (shm == NULL)
+		return;
+
+	write_begin();
+	shm->jobsread = jobsread;
+	shm->jobsdone = jobsdone;
+	shm->njobs = njobs;
+	write_end();
+}
+
+
+void shmstats_dispatch(int place)
+{
+	if (shm == NULL)
+		return;
+
+	write_begin();
+	shm->running++;
+	shm->places[place].running++;
+	write_end();
+}
+
+
+void shmstats_job_ack(const struct job_ack *joback, int jobdone)
+{
+	if (shm == NULL)
+		return;
+
+	write_begin();
+
+	shm->running--;
+	shm->places[joback->place].running--;
+
+	if (!jobdone)
+		shm->requeued++;
+	else if (joback->result != JOB_SUCCESS)
+		shm->jobsfailed++;
+
+	write_end();
+}
+
+
+void shmstats_job_cancel(int place)
+{
+	if (shm == NULL)
+		return;
+
+	write_begin();
+	shm->running--;
+	shm->places[place].running--;
+	write_end();
+}
+
+
+void shmstats_place_broken(int place)
+{
+	if (shm == NULL || shm->places[place].broken)
+		return;
+
+	write_begin();
+	shm->places[place].broken = 1;
+	shm->brokenplaces++;
+	write_end();
+}
+
+
+void shmstats_place_restored(int place)
+{
+	if (shm == NULL || !shm->places[place].broken)
+		return;
+
+	write_begin();
+	shm->places[place].broken = 0;
+	shm->brokenplaces--;
+	write_end();
+}
+
+
+void shmstats_maxissue(int place, int maxissue)
+{
+	if (shm == NULL)
+		return;
+
+	write_begin();
+	shm->places[place].maxissue = maxissue;
+	write_end();
+}
+
+
+void shmstats_eta(const struct etaestimate *est)
+{
+	if (shm == NULL)
+		return;
+
+	write_begin();
+	shm->etatime = monotonic_ns();
+	shm->rate = est->rate;
+	shm->eta = est->eta;
+	shm->etalow = est->low;
+	shm->etahigh = est->high;
+	write_end();
+}
+
+
+void shmstats_close(void)
+{
+	if (shm == NULL)
+		return;
+
+	munmap(shm, shmsize);
+	shm = NULL;
+
+	remove_shmstats();
+}
+
+
+/* Copy a consistent snapshot of the page into copy */
+static void read_snapshot(struct shmstats *copy, const struct shmstats *page,
+			  size_t size)
+{
+	uint64_t seq;
+
+	while (1) {
+		seq = __atomic_load_n(&page->seq, __ATOMIC_ACQUIRE);
+
+		if ((seq & 1) == 0) {
+			memcpy(copy, page, size);
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+			if (__atomic_load_n(&page->seq, __ATOMIC_RELAXED) == seq)
+				break;
+		}
+
+		sched_yield();
+	}
+}
+
+
+/* Print counters of the jobqueue process pid. Returns an exit code. */
+int shmstats_print(pid_t pid)
+{
+	char fname[PATH_MAX];
+	struct stat st;
+	struct shmstats *page;
+	struct shmstats *copy;
+	uint64_t now;
+	double age;
+	uint64_t i;
+	int fd;
+
+	shmstats_name(fname, sizeof fname, pid);
+
+	fd = open(fname, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		fprintf(stderr, "Can not open %s: %s\n", fname, strerror(errno));
+		return 1;
+	}
+
+	if (fstat(fd, &st))
+		dieerror("Can not stat %s", fname);
+
+	if (st.st_size < sizeof(struct shmstats)) {
+		fprintf(stderr, "%s is not a jobqueue stats file\n", fname);
+		return 1;
+	}
+
+	page = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (page == MAP_FAILED)
+		dieerror("Can not mmap %s", fname);
+
+	if (memcmp(page->magic, SHMSTATS_MAGIC, sizeof page->magic) ||
+	    shmstats_size(page->nplaces) != st.st_size) {
+		fprintf(stderr, "%s is not a jobqueue stats file\n", fname);
+		return 1;
+	}
+
+	copy = malloc(st.st_size);
+	if (copy == NULL)
+		die("No memory for stats\n");
+
+	read_snapshot(copy, page, st.st_size);
+	munmap(page, st.st_size);
+
+	now = monotonic_ns();
+
+	printf("jobqueue %d%s: running for %.1fs, updated %.1fs ago\n",
+	       (int) pid, kill(pid, 0) && errno == ESRCH ? " (not running)" : "",
+	       (now - copy->starttime) / 1000000000.0,
+	       (now - copy->updatetime) / 1000000000.0);
+
+	printf("jobs: read %llu, done %llu, failed %llu, requeued %llu, running %llu",
+	       (unsigned long long) copy->jobsread,
+	       (unsigned long long) copy->jobsdone,
+	       (unsigned long long) copy->jobsfailed,
+	       (unsigned long long) copy->requeued,
+	       (unsigned long long) copy->running);
+	if (copy->njobs > 0)
+		printf(", total %llu", (unsigned long long) copy->njobs);
+	printf("\n");
+
+	if (copy->eta >= 0) {
+		age = (now - copy->etatime) / 1000000000.0;
+		printf("rate %.2f jobs/s, ETA %.0fs (%.0f-%.0fs)\n", copy->rate,
+		       copy->eta > age ? copy->eta - age : 0.0,
+		       copy->etalow > age ? copy->etalow - age : 0.0,
+		       copy->etahigh > age ? copy->etahigh - age : 0.0);
+	}
+
+	printf("places: %llu, broken %llu\n",
+	       (unsigned long long) copy->nplaces,
+	       (unsigned long long) copy->brokenplaces);
+
+	for (i = 0; i < copy->nplaces; i++) {
+		printf("  %-20.*s running %u/%u%s\n", SHMSTATS_NAME_SIZE,
+		       copy->places[i].name, copy->places[i].running,
+		       copy->places[i].maxissue,
+		       copy->places[i].broken ? " broken" : "");
+	}
+
+	free(copy);
+
+	return 0;
+}
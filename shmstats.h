@@ -0,0 +1,23 @@
+#ifndef _JOBQUEUE_SHMSTATS_H_
+#define _JOBQUEUE_SHMSTATS_H_
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "eta.h"
+#include "schedule.h"
+
+void shmstats_open(const struct executionplace *places, int nplaces);
+void shmstats_jobs(size_t jobsread, size_t jobsdone, size_t njobs);
+void shmstats_dispatch(int place);
+void shmstats_job_ack(const struct job_ack *joback, int jobdone);
+void shmstats_job_cancel(int place);
+void shmstats_place_broken(int place);
+void shmstats_place_restored(int place);
+void shmstats_maxissue(int place, int maxissue);
+void shmstats_eta(const struct etaestimate *est);
+void shmstats_close(void);
+
+int shmstats_print(pid_t pid);
+
+#endif
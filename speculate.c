@@ -0,0 +1,132 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "jobqueue.h"
+#include "speculate.h"
+#include "stats.h"
+#include "support.h"
+
+/* Speculative execution (--speculate=k). When there are no more jobs to
+ * start, a running job that has run longer than k times the median job
+ * duration is a straggler, and a copy of it is started on a free
+ * execution place, preferably another place than the one running the
+ * straggler. The scheduler lets the first copy to succeed win, and kills
+ * the other one (see settle_copies() in schedule.c).
+ *
+ * The median is taken from the duration histogram of stats.c. It is not
+ * trusted before SPECULATE_MIN_SAMPLES executions have finished.
+ */
+
+#define SPECULATE_MIN_SAMPLES 5
+
+
+/* Returns the straggler threshold in ns, or 0 if it is not known yet */
+static uint64_t straggler_threshold(void)
+{
+	size_t n;
+	double median = stats_median_duration(&n);
+
+	if (n < SPECULATE_MIN_SAMPLES)
+		return 0;
+
+	return speculatefactor * median * 1000000000.0;
+}
+
+
+static int has_free_slot(const struct executionplace *place)
+{
+	return !place->broken && place->jobsrunning < place->maxissue;
+}
+
+
+/* Returns the job that has run longest among stragglers that do not have a
+ * copy yet, and sets *place to a free execution place for its copy.
+ * Returns NULL if there is no such job or place. */
+struct job *speculate_find(const struct executionplace *places, int nplaces,
+			   int *place)
+{
+	uint64_t threshold = straggler_threshold();
+	uint64_t now = monotonic_ns();
+	struct job *straggler = NULL;
+	struct job *job;
+	int stragglerplace = -1;
+	int i, slot;
+
+	if (threshold == 0)
+		return NULL;
+
+	for (i = 0; i < nplaces; i++) {
+		for (slot = 0; slot < places[i].nslots; slot++) {
+			job = places[i].slots[slot];
+			if (job == NULL || job->copy != NULL ||
+			    job->cancelled || job->timedout ||
+			    job == places[i].probe)
+				continue;
+
+			if (now - job->dispatchtime < threshold)
+				continue;
+
+			if (straggler == NULL ||
+			    job->dispatchtime < straggler->dispatchtime) {
+				straggler = job;
+				stragglerplace = i;
+			}
+		}
+	}
+
+	if (straggler == NULL)
+		return NULL;
+
+	/* The place of the straggler may be slow or overloaded, so it is only
+	   used when no other place has a free slot */
+	for (i = 0; i < nplaces; i++) {
+		if (i != stragglerplace && has_free_slot(&places[i])) {
+			*place = i;
+			return straggler;
+		}
+	}
+
+	if (!has_free_slot(&places[stragglerplace]))
+		return NULL;
+
+	*place = stragglerplace;
+	return straggler;
+}
+
+
+/* Returns milliseconds until the next running job becomes a straggler, or
+ * -1 if no job will */
+int speculate_timeout(const struct executionplace *places, int nplaces)
+{
+	uint64_t threshold = straggler_threshold();
+	uint64_t now = monotonic_ns();
+	uint64_t elapsed;
+	uint64_t next = UINT64_MAX;
+	struct job *job;
+	int i, slot;
+
+	if (threshold == 0)
+		return -1;
+
+	for (i = 0; i < nplaces; i++) {
+		for (slot = 0; slot < places[i].nslots; slot++) {
+			job = places[i].slots[slot];
+			if (job == NULL || job->copy != NULL ||
+			    job->cancelled || job->timedout ||
+			    job == places[i].probe)
+				continue;
+
+			/* Stragglers wait for a free place instead */
+			elapsed = now - job->dispatchtime;
+			if (elapsed < threshold && threshold - elapsed < next)
+				next = threshold - elapsed;
+		}
+	}
+
+	if (next == UINT64_MAX)
+		return -1;
+
+	/* Round up, so that the job is a straggler when the wait ends */
+	return next / 1000000 + 1;
+}
@@ -0,0 +1,10 @@
+#ifndef _JOBQUEUE_SPECULATE_H_
+#define _JOBQUEUE_SPECULATE_H_
+
+#include "schedule.h"
+
+struct job *speculate_find(const struct executionplace *places, int nplaces,
+			   int *place);
+int speculate_timeout(const struct executionplace *places, int nplaces);
+
+#endif
@@ -0,0 +1,379 @@
+#define _GNU_SOURCE
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdint.h>
+#include <math.h>
+#include <assert.h>
+
+#include "jobqueue.h"
+#include "stats.h"
+#include "support.h"
+
+/* Job durations are kept in a histogram with logarithmic buckets, so that
+ * percentiles can be computed for any number of jobs in constant space.
+ * There are HIST_BUCKETS_PER_OCTAVE buckets for each doubling of duration,
+ * starting from 1 us. The relative error of a percentile is below 5 %.
+ */
+#define HIST_BUCKETS_PER_OCTAVE 8
+#define HIST_OCTAVES 40
+#define HIST_BUCKETS (HIST_BUCKETS_PER_OCTAVE * HIST_OCTAVES)
+
+#define NSLOWEST 5
+
+/* Each piece of a results line is written separately, and the longest
+   piece is a command with all characters quoted (see write_csv_string()) */
+#define RESULTS_BUFFER_SIZE (4 * MAX_CMD_SIZE)
+
+struct placestats {
+	size_t njobs;
+	size_t nfailed;
+	uint64_t busy;
+	double utime;
+	double stime;
+	long maxrss;
+	long minflt;
+	long majflt;
+};
+
+struct slowjob {
+	size_t jobnumber;
+	int place;
+	uint64_t duration;
+	char *cmd;
+};
+
+static int nstatplaces;
+static struct placestats *placestats;
+static uint64_t runstart;
+static uint64_t idletime;
+
+static size_t njobacks;
+static size_t nfailedacks;
+static uint64_t totalduration;
+static uint64_t maxduration;
+static size_t histogram[HIST_BUCKETS];
+static struct slowjob slowest[NSLOWEST];
+
+static int resultsfd = -1;
+static char *resultsbuf;
+static size_t resultsbuflen;
+
+
+static double timeval_to_double(const struct timeval *tv)
+{
+	return tv->tv_sec + tv->tv_usec / 1000000.0;
+}
+
+
+static double ns_to_s(uint64_t ns)
+{
+	return ns / 1000000000.0;
+}
+
+
+static void flush_results(void)
+{
+	size_t written = 0;
+	ssize_t ret;
+
+	while (written < resultsbuflen) {
+		ret = write(resultsfd, resultsbuf + written,
+			    resultsbuflen - written);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			dieerror("Can not write results file");
+		}
+		written += ret;
+	}
+
+	resultsbuflen = 0;
+}
+
+
+/* Results are buffered by hand instead of stdio, so that each write() of
+ * the buffer is checked where it happens and a failure is reported with
+ * its errno. Runner children inherit the buffer, but they leave with
+ * _exit() and never flush it. */
+static void write_results(const char *fmt, ...) __attribute__ ((format (printf, 1, 2)));
+
+static void write_results(const char *fmt, ...)
+{
+	va_list ap;
+	int ret;
+
+	while (1) {
+		va_start(ap, fmt);
+		ret = vsnprintf(resultsbuf + resultsbuflen,
+				RESULTS_BUFFER_SIZE - resultsbuflen, fmt, ap);
+		va_end(ap);
+
+		assert(ret >= 0);
+
+		if (resultsbuflen + ret < RESULTS_BUFFER_SIZE)
+			break;
+
+		assert(resultsbuflen > 0);
+
+		flush_results();
+	}
+
+	resultsbuflen += ret;
+}
+
+
+static void write_csv_string(const char *s)
+{
+	char quoted[2 * MAX_CMD_SIZE + 3];
+	size_t i = 0;
+
+	quoted[i++] = '"';
+
+	for (; *s != 0; s++) {
+		if (*s == '"')
+			quoted[i++] = '"';
+		quoted[i++] = *s;
+	}
+
+	quoted[i++] = '"';
+	quoted[i] = 0;
+
+	write_results("%s", quoted);
+}
+
+
+void stats_init(int nplaces)
+{
+	nstatplaces = nplaces;
+
+	placestats = calloc(nplaces, sizeof placestats[0]);
+	if (placestats == NULL)
+		die("No memory for statistics\n");
+
+	runstart = monotonic_ns();
+
+	if (resultsfile == NULL)
+		return;
+
+	resultsfd = open(resultsfile, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+			 0666);
+	if (resultsfd < 0)
+		dieerror("Can not open results file %s", resultsfile);
+
+	resultsbuf = malloc(RESULTS_BUFFER_SIZE);
+	if (resultsbuf == NULL)
+		die("No memory for results buffer\n");
+
+	write_results("jobnumber,place,result,retries,dispatch,start,end,"
+		      "utime,stime,maxrss,minflt,majflt,command\n");
+}
+
+
+static void add_slow_job(const struct job_ack *joback, uint64_t duration)
+{
+	int i = NSLOWEST - 1;
+
+	if (slowest[i].cmd != NULL && slowest[i].duration >= duration)
+		return;
+
+	free(slowest[i].cmd);
+
+	while (i > 0 && (slowest[i - 1].cmd == NULL ||
+			 slowest[i - 1].duration < duration)) {
+		slowest[i] = slowest[i - 1];
+		i--;
+	}
+
+	slowest[i] = (struct slowjob) {.jobnumber = joback->job->jobnumber,
+				       .place = joback->place,
+				       .duration = duration,
+				       .cmd = strdup(joback->job->cmd)};
+}
+
+
+static int histogram_bucket(uint64_t duration)
+{
+	double us = duration / 1000.0;
+	int bucket;
+
+	if (us < 1.0)
+		return 0;
+
+	bucket = log2(us) * HIST_BUCKETS_PER_OCTAVE;
+
+	return (bucket < HIST_BUCKETS) ? bucket : (HIST_BUCKETS - 1);
+}
+
+
+/* Return the duration of percentile p (0 < p < 1) in seconds */
+static double histogram_percentile(double p)
+{
+	size_t target = ceil(p * njobacks);
+	size_t sum = 0;
+	int i;
+
+	for (i = 0; i < HIST_BUCKETS; i++) {
+		sum += histogram[i];
+		if (sum >= target)
+			break;
+	}
+
+	/* Geometric middle point of the bucket, in seconds */
+	return pow(2.0, (i + 0.5) / HIST_BUCKETS_PER_OCTAVE) / 1000000.0;
+}
+
+
+/* Account one execution of a job */
+void stats_job_ack(const struct job_ack *joback)
+{
+	struct placestats *ps;
+	const struct rusage *ru = &joback->rusage;
+	uint64_t duration = 0;
+
+	assert(joback->place < nstatplaces);
+	ps = &placestats[joback->place];
+
+	if (joback->end > joback->start)
+		duration = joback->end - joback->start;
+
+	njobacks++;
+	totalduration += duration;
+	if (duration > maxduration)
+		maxduration = duration;
+	histogram[histogram_bucket(duration)]++;
+
+	ps->njobs++;
+	ps->busy += duration;
+	ps->utime += timeval_to_double(&ru->ru_utime);
+	ps->stime += timeval_to_double(&ru->ru_stime);
+	if (ru->ru_maxrss > ps->maxrss)
+		ps->maxrss = ru->ru_maxrss;
+	ps->minflt += ru->ru_minflt;
+	ps->majflt += ru->ru_majflt;
+
+	if (joback->result != JOB_SUCCESS) {
+		nfailedacks++;
+		ps->nfailed++;
+	}
+
+	add_slow_job(joback, duration);
+
+	if (resultsfd < 0)
+		return;
+
+	write_results("%zu,%d,%d,%d,%.6f,%.6f,%.6f,%.6f,%.6f,%ld,%ld,%ld,",
+		      joback->job->jobnumber, joback->place + 1,
+		      joback->result, joback->job->retries,
+		      ns_to_s(joback->job->dispatchtime - runstart),
+		      ns_to_s(joback->start - runstart),
+		      ns_to_s(joback->end - runstart),
+		      timeval_to_double(&ru->ru_utime),
+		      timeval_to_double(&ru->ru_stime),
+		      ru->ru_maxrss, ru->ru_minflt, ru->ru_majflt);
+	write_csv_string(joback->job->cmd);
+	write_results("\n");
+}
+
+
+/* Returns the median duration of executions in seconds, and sets *n to
+ * the number of executions */
+double stats_median_duration(size_t *n)
+{
+	*n = njobacks;
+
+	if (njobacks == 0)
+		return 0.0;
+
+	return histogram_percentile(0.50);
+}
+
+
+/* Account time that the scheduler spent waiting for jobs to finish */
+void stats_idle(uint64_t ns)
+{
+	idletime += ns;
+}
+
+
+static void print_place_name(int place, int width)
+{
+	struct machine *m;
+
+	if (vplist_is_empty(&machinelist)) {
+		fprintf(stderr, "%-*d", width, place + 1);
+	} else {
+		m = vplist_get(&machinelist, place);
+		assert(m != NULL);
+		fprintf(stderr, "%-*s", width, m->name);
+	}
+}
+
+
+void stats_report(void)
+{
+	uint64_t walltime = monotonic_ns() - runstart;
+	double wall = ns_to_s(walltime);
+	struct placestats *ps;
+	int i;
+
+	if (!printsummary)
+		return;
+
+	fprintf(stderr, "\nRun summary:\n");
+	fprintf(stderr, "  Executions: %zd (%zd failed)\n", njobacks,
+		nfailedacks);
+	fprintf(stderr, "  Wall time: %.3fs, scheduler busy %.3fs, idle %.3fs\n",
+		wall, ns_to_s(walltime - idletime), ns_to_s(idletime));
+
+	if (njobacks == 0)
+		return;
+
+	fprintf(stderr, "  Duration: mean %.3fs, p50 %.3fs, p90 %.3fs, p99 %.3fs, max %.3fs\n",
+		ns_to_s(totalduration) / njobacks,
+		histogram_percentile(0.50), histogram_percentile(0.90),
+		histogram_percentile(0.99), ns_to_s(maxduration));
+
+	fprintf(stderr, "  Slowest jobs:\n");
+	for (i = 0; i < NSLOWEST && slowest[i].cmd != NULL; i++) {
+		fprintf(stderr, "    %10.3fs job %zd place ",
+			ns_to_s(slowest[i].duration), slowest[i].jobnumber);
+		print_place_name(slowest[i].place, 0);
+		fprintf(stderr, ": %s\n", slowest[i].cmd);
+	}
+
+	fprintf(stderr, "  Places:\n");
+	fprintf(stderr, "    %-20s %8s %8s %8s %10s %10s %10s %10s %10s %8s\n",
+		"place", "jobs", "failed", "jobs/s", "busy s", "user s",
+		"sys s", "maxrss kB", "minflt", "majflt");
+
+	for (i = 0; i < nstatplaces; i++) {
+		ps = &placestats[i];
+		fprintf(stderr, "    ");
+		print_place_name(i, 20);
+		fprintf(stderr, " %8zd %8zd %8.2f %10.3f %10.3f %10.3f %10ld %10ld %8ld\n",
+			ps->njobs, ps->nfailed,
+			wall > 0 ? ps->njobs / wall : 0.0,
+			ns_to_s(ps->busy), ps->utime, ps->stime, ps->maxrss,
+			ps->minflt, ps->majflt);
+	}
+}
+
+
+void stats_close(void)
+{
+	if (resultsfd < 0)
+		return;
+
+	flush_results();
+
+	if (close(resultsfd))
+		dieerror("Can not close results file");
+
+	resultsfd = -1;
+}
@@ -0,0 +1,15 @@
+#ifndef _JOBQUEUE_STATS_H_
+#define _JOBQUEUE_STATS_H_
+
+#include <stdint.h>
+
+#include "schedule.h"
+
+void stats_init(int nplaces);
+void stats_job_ack(const struct job_ack *joback);
+void stats_idle(uint64_t ns);
+double stats_median_duration(size_t *n);
+void stats_report(void);
+void stats_close(void);
+
+#endif
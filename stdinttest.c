@@ -0,0 +1,2 @@
+#include <stdint.h>
+int main(void) {uint8_t a = 0; uint32_t b = 0; return 0; }
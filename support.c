@@ -1,8 +1,10 @@
+#include <stdlib.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <ctype.h>
 #include <string.h>
 #include <errno.h>
+#include <time.h>
 
 #include "support.h"
 
@@ -24,6 +26,69 @@ int closeonexec(int fd)
 }
 
 
+/* Return the number of processors listed in /proc/cpuinfo, or 1 */
+int cpuinfo_processors(void)
+{
+	FILE *f;
+	char line[256];
+	int n = 0;
+
+	f = fopen("/proc/cpuinfo", "r");
+	if (f == NULL)
+		return 1;
+
+	while (fgets(line, sizeof line, f) != NULL) {
+		if (strncmp(line, "processor", 9) == 0 &&
+		    (line[9] == ' ' || line[9] == '\t' || line[9] == ':'))
+			n++;
+	}
+
+	fclose(f);
+
+	return n > 0 ? n : 1;
+}
+
+
+/* Final avalanche of MurmurHash3: FNV-1a alone mixes high bits poorly, and
+ * hash table indices are taken from low bits */
+uint64_t fmix64(uint64_t h)
+{
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+
+	return h;
+}
+
+
+/* Continue FNV-1a hash h with data. The initial h is FNV1A_INITIAL. */
+uint64_t fnv1a(uint64_t h, const void *data, size_t len)
+{
+	const unsigned char *p = data;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		h ^= p[i];
+		h *= 0x100000001b3ULL;
+	}
+
+	return h;
+}
+
+
+/* Return CLOCK_MONOTONIC time in nanoseconds */
+uint64_t monotonic_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ((uint64_t) ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+
 int pipe_closeonexec(int p[2])
 {
 	if (pipe(p))
@@ -40,6 +105,16 @@ int pipe_closeonexec(int p[2])
  * strip \n away. Returns line length.
  */
 ssize_t read_stripped_line(char *buf, size_t buflen, FILE *f)
+{
+	return read_stripped_line_offset(buf, buflen, f, NULL);
+}
+
+/* Same as read_stripped_line(), but if offset != NULL, the number of bytes
+ * consumed from 'f' is added to *offset. This is much cheaper than calling
+ * ftello() for each line.
+ */
+ssize_t read_stripped_line_offset(char *buf, size_t buflen, FILE *f,
+				  off_t *offset)
 {
 	size_t len;
 
@@ -52,6 +127,9 @@ ssize_t read_stripped_line(char *buf, size_t buflen, FILE *f)
 
 	len = strlen(buf);
 
+	if (offset != NULL)
+		*offset += len;
+
 	if (buf[len - 1] == '\n') {
 		len--;
 		buf[len] = 0;
@@ -60,6 +138,43 @@ ssize_t read_stripped_line(char *buf, size_t buflen, FILE *f)
 	return len;
 }
 
+/* Parse a size in bytes with an optional K, M, G or T suffix (powers of
+ * 1024) into *size. Returns 0 on success, and -1 on error.
+ */
+int parse_size(const char *s, uint64_t *size)
+{
+	char *end;
+	double value;
+	double multiplier = 1;
+
+	value = strtod(s, &end);
+	if (end == s || !(value >= 0))
+		return -1;
+
+	switch (toupper(*end)) {
+	case 'T':
+		multiplier *= 1024;
+		/* fall through */
+	case 'G':
+		multiplier *= 1024;
+		/* fall through */
+	case 'M':
+		multiplier *= 1024;
+		/* fall through */
+	case 'K':
+		multiplier *= 1024;
+		end++;
+		break;
+	}
+
+	if (*end != 0)
+		return -1;
+
+	*size = value * multiplier;
+
+	return 0;
+}
+
 /* Skip whitespace characters in string starting from offset i. Returns offset
  * j >= i as the next non-whitespace character offset, or -1 if non-whitespace
  * are not found.
@@ -5,6 +5,8 @@
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
+#include <stdint.h>
+#include <sys/types.h>
 
 #define die(fmt, args...) do { \
     fprintf(stderr, fmt, ## args); \
@@ -16,13 +18,22 @@
 	exit(1); \
 } while(0)
 
+#define FNV1A_INITIAL 0xcbf29ce484222325ULL
+
 
 void can_not_open_file(const char *fname);
 
 int closeonexec(int fd);
+int cpuinfo_processors(void);
+uint64_t fmix64(uint64_t h);
+uint64_t fnv1a(uint64_t h, const void *data, size_t len);
+uint64_t monotonic_ns(void);
+int parse_size(const char *s, uint64_t *size);
 int pipe_closeonexec(int p[2]);
 
 ssize_t read_stripped_line(char *buf, size_t buflen, FILE *f);
+ssize_t read_stripped_line_offset(char *buf, size_t buflen, FILE *f,
+				  off_t *offset);
 
 int skipnws(const char *s, int i);
 int skipws(const char *s, int i);
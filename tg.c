@@ -77,24 +77,109 @@ static int get_next_and_terminate(int *nexti, char *line, int i)
 	return i;
 }
 
-static void handle_nodes(struct dgraph *tg, struct vplist *nodelist)
+static int tgnodecmp(const void *a, const void *b)
+{
+	const struct tgnode *na = (*(const struct dgnode **) a)->data;
+	const struct tgnode *nb = (*(const struct dgnode **) b)->data;
+
+	return strcmp(na->name, nb->name);
+}
+
+/* Return an array of graph->n node pointers sorted by node name. Dies
+ * on duplicate node names. The array must be freed with free().
+ */
+static struct dgnode **sort_nodes_by_name(struct dgraph *tg)
 {
-	struct vplist *lnode;
+	struct dgnode **sorted;
 	struct tgnode *tgnode;
+	size_t i;
 
-	/* XXX: Optimize O(n^2) -> O(n log n) */
-	while ((tgnode = vplist_pop_head(nodelist)) != NULL) {
+	sorted = malloc(tg->n * sizeof sorted[0]);
+	if (sorted == NULL && tg->n > 0)
+		die("No memory for sorting task graph nodes\n");
+
+	for (i = 0; i < tg->n; i++)
+		sorted[i] = &tg->nodes[i];
 
-		VPLIST_FOR_EACH(lnode, nodelist) {
-			if (strcmp(lnode->item, tgnode->name) == 0)
-				die("Duplicate node %s\n", tgnode->name);
+	qsort(sorted, tg->n, sizeof sorted[0], tgnodecmp);
+
+	for (i = 1; i < tg->n; i++) {
+		if (tgnodecmp(&sorted[i - 1], &sorted[i]) == 0) {
+			tgnode = sorted[i]->data;
+			die("Duplicate node %s\n", tgnode->name);
 		}
+	}
+
+	return sorted;
+}
+
+static size_t find_node(struct dgnode **sorted, size_t n, char *name)
+{
+	struct tgnode key = {.name = name};
+	struct dgnode keynode = {.data = &key};
+	struct dgnode *keyp = &keynode;
+	struct dgnode **found;
+
+	found = bsearch(&keyp, sorted, n, sizeof sorted[0], tgnodecmp);
+	if (found == NULL)
+		return -1;
+
+	return (*found)->i;
+}
+
+static void handle_nodes(struct dgraph *tg, struct vplist *nodelist)
+{
+	struct tgnode *tgnode;
 
+	while ((tgnode = vplist_pop_head(nodelist)) != NULL) {
 		if (agl_add_node(tg, tgnode))
 			die("Can not add node %s\n", tgnode->name);
 	}
 }
 
+/* Edges may refer to nodes given in any job file read so far. The
+ * struct tgedge is stored as edge data so that edge costs stay available
+ * for the scheduler.
+ */
+static void handle_edges(struct dgraph *tg, struct vplist *edgelist)
+{
+	struct dgnode **sorted;
+	struct tgedge *tgedge;
+	size_t src, dst;
+	int cyclic;
+	size_t *order;
+
+	sorted = sort_nodes_by_name(tg);
+
+	while ((tgedge = vplist_pop_head(edgelist)) != NULL) {
+		src = find_node(sorted, tg->n, tgedge->src);
+		dst = find_node(sorted, tg->n, tgedge->dst);
+
+		if (src == -1 || dst == -1)
+			die("Edge %s -> %s refers to an unknown node\n",
+			    tgedge->src, tgedge->dst);
+
+		if (agl_add_edge(tg, src, dst, tgedge))
+			die("Can not add edge %s -> %s\n", tgedge->src,
+			    tgedge->dst);
+	}
+
+	free(sorted);
+
+	if (tg->n == 0)
+		return;
+
+	order = agl_topological_sort(&cyclic, tg);
+	if (order == NULL) {
+		if (cyclic)
+			die("Task graph has cycles\n");
+
+		die("No memory for checking task graph cycles\n");
+	}
+
+	free(order);
+}
+
 static int parse_line(struct vplist *nodelist, struct vplist *edgelist,
 		      char *line)
 {
@@ -202,6 +287,10 @@ void tg_parse_jobfile(struct jobqueue *queue, char *jobfilename)
 	}
 
 	handle_nodes(tgjobs->tg, &nodelist);
+	handle_edges(tgjobs->tg, &edgelist);
+
+	tgjobs->ngraphs++;
+	tgjobs->njobs = tgjobs->tg->n;
 
 	fclose(jobfile);
 }
@@ -0,0 +1,79 @@
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "jobqueue.h"
+#include "timeout.h"
+#include "support.h"
+
+/* Time limits of running jobs (--timeout and the timeout job attribute).
+ * The scheduler looks for jobs over their limit in each iteration of its
+ * loop, and wakes up from waiting when the next limit passes. Running
+ * jobs are found in the slots of execution places. The scheduler only
+ * calls these functions when a running job has a time limit.
+ */
+
+
+static int over_limit(const struct job *job, uint64_t now)
+{
+	return now - job->dispatchtime >= job->timeout;
+}
+
+
+/* Returns a running job that is over its time limit and has not been
+ * killed yet, and sets *place to its execution place. Returns NULL if
+ * there is no such job. */
+struct job *timeout_expired(const struct executionplace *places, int nplaces,
+			    int *place)
+{
+	uint64_t now = monotonic_ns();
+	struct job *job;
+	int i, slot;
+
+	for (i = 0; i < nplaces; i++) {
+		for (slot = 0; slot < places[i].nslots; slot++) {
+			job = places[i].slots[slot];
+			if (job == NULL || job->timeout == 0 || job->timedout ||
+			    job->cancelled)
+				continue;
+
+			if (over_limit(job, now)) {
+				*place = i;
+				return job;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+
+/* Returns milliseconds until the next running job goes over its time
+ * limit, or -1 if no running job has a limit */
+int timeout_next(const struct executionplace *places, int nplaces)
+{
+	uint64_t now = monotonic_ns();
+	uint64_t next = UINT64_MAX;
+	uint64_t left;
+	struct job *job;
+	int i, slot;
+
+	for (i = 0; i < nplaces; i++) {
+		for (slot = 0; slot < places[i].nslots; slot++) {
+			job = places[i].slots[slot];
+			if (job == NULL || job->timeout == 0 || job->timedout ||
+			    job->cancelled)
+				continue;
+
+			left = over_limit(job, now) ? 0 :
+				job->dispatchtime + job->timeout - now;
+			if (left < next)
+				next = left;
+		}
+	}
+
+	if (next == UINT64_MAX)
+		return -1;
+
+	/* Round up, so that the job is over its limit when the wait ends */
+	return (next + 999999) / 1000000;
+}
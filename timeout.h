@@ -0,0 +1,10 @@
+#ifndef _JOBQUEUE_TIMEOUT_H_
+#define _JOBQUEUE_TIMEOUT_H_
+
+#include "schedule.h"
+
+struct job *timeout_expired(const struct executionplace *places, int nplaces,
+			    int *place);
+int timeout_next(const struct executionplace *places, int nplaces);
+
+#endif
@@ -0,0 +1,373 @@
+#define _GNU_SOURCE
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdint.h>
+#include <assert.h>
+#include <pthread.h>
+#include <signal.h>
+
+#include "jobqueue.h"
+#include "support.h"
+#include "trace.h"
+
+/* Execution trace in Chrome trace event format (JSON array form), which is
+ * understood by chrome://tracing and Perfetto. Each slot of an execution
+ * place is a thread track. A job execution is a complete ("X") event on the
+ * track of the slot that ran it.
+ *
+ * Events are formatted into fixed size buffers. Full buffers are written
+ * to the file by a writer thread, so the scheduler never blocks on file
+ * I/O unless all buffers are waiting to be written.
+ */
+
+/* Maximum length of one event. A command may be escaped to twice its
+   length. */
+#define TRACE_EVENT_SIZE (2 * MAX_CMD_SIZE + 512)
+
+/* A buffer must hold at least one event of maximum length */
+#define TRACE_BUFFER_SIZE (2 * TRACE_EVENT_SIZE)
+#define TRACE_NBUFFERS 8
+
+#define TRACE_PID 1
+#define TRACE_TID(place, slot) ((place) * 100000LL + (slot) + 1)
+
+struct tracebuffer {
+	size_t len;
+	char data[TRACE_BUFFER_SIZE];
+};
+
+static int tracefd = -1;
+static uint64_t tracestart;
+static pthread_t writerthread;
+
+/* All fields below are protected by tracelock, except current */
+static pthread_mutex_t tracelock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t tracecond = PTHREAD_COND_INITIALIZER;
+static struct tracebuffer *fullbuffers[TRACE_NBUFFERS];
+static int fullhead;
+static int nfull;
+static struct tracebuffer *freebuffers[TRACE_NBUFFERS];
+static int nfree;
+static int closing;
+
+/* The buffer that the scheduler is formatting events into */
+static struct tracebuffer *current;
+
+/* Number of named slot tracks for each place */
+static int *namedslots;
+static int nnamedplaces;
+
+static char eventbuf[TRACE_EVENT_SIZE];
+
+
+static void write_buffer(struct tracebuffer *buf)
+{
+	size_t written = 0;
+	ssize_t ret;
+
+	while (written < buf->len) {
+		ret = write(tracefd, buf->data + written, buf->len - written);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			dieerror("Can not write trace");
+		}
+		written += ret;
+	}
+
+	buf->len = 0;
+}
+
+
+static void *trace_writer(void *arg)
+{
+	struct tracebuffer *buf;
+
+	pthread_mutex_lock(&tracelock);
+
+	while (1) {
+		while (nfull == 0 && !closing)
+			pthread_cond_wait(&tracecond, &tracelock);
+
+		if (nfull == 0)
+			break;
+
+		buf = fullbuffers[fullhead];
+		fullhead = (fullhead + 1) % TRACE_NBUFFERS;
+		nfull--;
+
+		pthread_mutex_unlock(&tracelock);
+
+		write_buffer(buf);
+
+		pthread_mutex_lock(&tracelock);
+
+		freebuffers[nfree++] = buf;
+		pthread_cond_broadcast(&tracecond);
+	}
+
+	pthread_mutex_unlock(&tracelock);
+
+	return NULL;
+}
+
+
+/* Queue the current buffer for writing and take a free buffer */
+static void submit_buffer(void)
+{
+	pthread_mutex_lock(&tracelock);
+
+	fullbuffers[(fullhead + nfull) % TRACE_NBUFFERS] = current;
+	nfull++;
+	pthread_cond_broadcast(&tracecond);
+
+	while (nfree == 0)
+		pthread_cond_wait(&tracecond, &tracelock);
+
+	current = freebuffers[--nfree];
+
+	pthread_mutex_unlock(&tracelock);
+}
+
+
+static void trace_printf(const char *fmt, ...) __attribute__ ((format (printf, 1, 2)));
+
+static void trace_printf(const char *fmt, ...)
+{
+	va_list ap;
+	int len;
+
+	va_start(ap, fmt);
+	len = vsnprintf(eventbuf, sizeof eventbuf, fmt, ap);
+	va_end(ap);
+
+	assert(len >= 0 && len < sizeof eventbuf);
+
+	if (current->len + len > TRACE_BUFFER_SIZE)
+		submit_buffer();
+
+	memcpy(current->data + current->len, eventbuf, len);
+	current->len += len;
+}
+
+
+/* Escape s for a JSON string. dst must have space for 2 * strlen(s) + 1
+ * characters. Control characters are replaced with spaces. */
+static char *json_escape(char *dst, const char *s)
+{
+	char *d = dst;
+
+	for (; *s != 0; s++) {
+		if (*s == '"' || *s == '\\')
+			*d++ = '\\';
+
+		*d++ = ((unsigned char) *s < 0x20) ? ' ' : *s;
+	}
+
+	*d = 0;
+
+	return dst;
+}
+
+
+static double trace_us(uint64_t ns)
+{
+	return (ns - tracestart) / 1000.0;
+}
+
+
+static void place_name(char *name, size_t size, int place)
+{
+	struct machine *m;
+
+	if (vplist_is_empty(&machinelist)) {
+		snprintf(name, size, "place %d", place + 1);
+	} else {
+		m = vplist_get(&machinelist, place);
+		assert(m != NULL);
+		snprintf(name, size, "%s", m->name);
+	}
+}
+
+
+/* Name tracks lazily, because the number of slots can change */
+static void name_slot_tracks(int place, int slot)
+{
+	char name[256];
+	char escaped[2 * sizeof name];
+	int *newnamed;
+	int i;
+
+	if (place >= nnamedplaces) {
+		newnamed = realloc(namedslots, (place + 1) * sizeof newnamed[0]);
+		if (newnamed == NULL)
+			die("No memory for trace\n");
+
+		for (i = nnamedplaces; i <= place; i++)
+			newnamed[i] = 0;
+
+		namedslots = newnamed;
+		nnamedplaces = place + 1;
+	}
+
+	place_name(name, sizeof name, place);
+	json_escape(escaped, name);
+
+	for (i = namedslots[place]; i <= slot; i++) {
+		trace_printf("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,"
+			     "\"tid\":%lld,\"args\":{\"name\":\"%s slot %d\"}},\n",
+			     TRACE_PID, TRACE_TID(place, i), escaped, i + 1);
+		trace_printf("{\"name\":\"thread_sort_index\",\"ph\":\"M\","
+			     "\"pid\":%d,\"tid\":%lld,\"args\":{\"sort_index\":%lld}},\n",
+			     TRACE_PID, TRACE_TID(place, i), TRACE_TID(place, i));
+	}
+
+	if (namedslots[place] <= slot)
+		namedslots[place] = slot + 1;
+}
+
+
+void trace_open(const char *fname)
+{
+	pthread_attr_t attr;
+	sigset_t allsignals, oldmask;
+	int i;
+	int ret;
+
+	tracefd = open(fname, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+	if (tracefd < 0)
+		dieerror("Can not open trace file %s", fname);
+
+	for (i = 0; i < TRACE_NBUFFERS; i++) {
+		freebuffers[i] = malloc(sizeof(struct tracebuffer));
+		if (freebuffers[i] == NULL)
+			die("No memory for trace buffers\n");
+
+		freebuffers[i]->len = 0;
+	}
+
+	nfree = TRACE_NBUFFERS;
+	current = freebuffers[--nfree];
+
+	tracestart = monotonic_ns();
+
+	/* The writer thread must not take signals that belong to the
+	   scheduler, such as SIGCHLD */
+	sigfillset(&allsignals);
+	pthread_sigmask(SIG_SETMASK, &allsignals, &oldmask);
+
+	pthread_attr_init(&attr);
+	ret = pthread_create(&writerthread, &attr, trace_writer, NULL);
+	pthread_attr_destroy(&attr);
+
+	pthread_sigmask(SIG_SETMASK, &oldmask, NULL);
+
+	if (ret)
+		die("Can not create trace writer thread: %s\n", strerror(ret));
+
+	trace_printf("[\n");
+	trace_printf("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+		     "\"args\":{\"name\":\"jobqueue\"}},\n", TRACE_PID);
+}
+
+
+void trace_job_ack(const struct job_ack *joback)
+{
+	char escaped[2 * MAX_CMD_SIZE + 1];
+	struct job *job = joback->job;
+
+	if (tracefd < 0)
+		return;
+
+	name_slot_tracks(joback->place, job->slot);
+
+	trace_printf("{\"name\":\"job %zd\",\"cat\":\"job\",\"ph\":\"X\","
+		     "\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%lld,"
+		     "\"args\":{\"cmd\":\"%s\",\"result\":%d,\"retries\":%d}},\n",
+		     job->jobnumber, trace_us(joback->start),
+		     (joback->end - joback->start) / 1000.0, TRACE_PID,
+		     TRACE_TID(joback->place, job->slot),
+		     json_escape(escaped, job->cmd), joback->result,
+		     job->retries);
+}
+
+
+void trace_retry(const struct job_ack *joback)
+{
+	struct job *job = joback->job;
+
+	if (tracefd < 0)
+		return;
+
+	trace_printf("{\"name\":\"retry job %zd\",\"cat\":\"retry\",\"ph\":\"i\","
+		     "\"s\":\"t\",\"ts\":%.3f,\"pid\":%d,\"tid\":%lld},\n",
+		     job->jobnumber, trace_us(joback->end), TRACE_PID,
+		     TRACE_TID(joback->place, job->slot));
+}
+
+
+void trace_place_broken(int place)
+{
+	char name[256];
+	char escaped[2 * sizeof name];
+
+	if (tracefd < 0)
+		return;
+
+	place_name(name, sizeof name, place);
+
+	trace_printf("{\"name\":\"%s broken\",\"cat\":\"place\",\"ph\":\"i\","
+		     "\"s\":\"p\",\"ts\":%.3f,\"pid\":%d,\"tid\":%lld},\n",
+		     json_escape(escaped, name), trace_us(monotonic_ns()),
+		     TRACE_PID, TRACE_TID(place, 0));
+}
+
+
+void trace_place_restored(int place)
+{
+	char name[256];
+	char escaped[2 * sizeof name];
+
+	if (tracefd < 0)
+		return;
+
+	place_name(name, sizeof name, place);
+
+	trace_printf("{\"name\":\"%s restored\",\"cat\":\"place\",\"ph\":\"i\","
+		     "\"s\":\"p\",\"ts\":%.3f,\"pid\":%d,\"tid\":%lld},\n",
+		     json_escape(escaped, name), trace_us(monotonic_ns()),
+		     TRACE_PID, TRACE_TID(place, 0));
+}
+
+
+void trace_close(void)
+{
+	if (tracefd < 0)
+		return;
+
+	/* The JSON array needs a last element without a trailing comma */
+	trace_printf("{\"name\":\"end\",\"ph\":\"i\",\"s\":\"g\",\"ts\":%.3f,"
+		     "\"pid\":%d,\"tid\":0}\n]\n",
+		     trace_us(monotonic_ns()), TRACE_PID);
+
+	pthread_mutex_lock(&tracelock);
+	fullbuffers[(fullhead + nfull) % TRACE_NBUFFERS] = current;
+	nfull++;
+	current = NULL;
+	closing = 1;
+	pthread_cond_broadcast(&tracecond);
+	pthread_mutex_unlock(&tracelock);
+
+	pthread_join(writerthread, NULL);
+
+	if (close(tracefd))
+		dieerror("Can not close trace file");
+
+	tracefd = -1;
+}
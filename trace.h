@@ -0,0 +1,13 @@
+#ifndef _JOBQUEUE_TRACE_H_
+#define _JOBQUEUE_TRACE_H_
+
+#include "schedule.h"
+
+void trace_open(const char *fname);
+void trace_job_ack(const struct job_ack *joback);
+void trace_retry(const struct job_ack *joback);
+void trace_place_broken(int place);
+void trace_place_restored(int place);
+void trace_close(void);
+
+#endif